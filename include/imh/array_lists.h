@@ -30,9 +30,12 @@ typedef struct Item {
 
 typedef struct List{
      uint size;
+     uint capacity;
      Item *data;
 }List;
 
+#define LIST_MIN_CAPACITY 8
+
 typedef struct Score{
 	double value;
 	uint index;
@@ -43,6 +46,9 @@ void list_init(List *);
 List list_create(uint);
 List list_random(uint, uint);
 void list_destroy(List *);
+void list_reserve(List *, uint);
+void list_grow(List *, uint);
+void list_shrink_to_fit(List *);
 Item list_make_item(uint, uint);
 Item *list_find(List *, Item);
 Item *list_min_item(List *);
@@ -85,6 +91,9 @@ List list_union(List *, List *);
 uint list_union_size(List *, List *);
 List list_intersection(List *, List *);
 uint list_intersection_size(List *, List *);
+uint list_intersection_size_column(List *, const uint *, uint);
+uint list_intersection_size_bounded(List *, List *, uint);
+uint list_intersection_size_column_bounded(List *, const uint *, uint, uint);
 List list_difference(List *, List *);
 uint list_difference_size(List *, List *);
 double list_jaccard(List *, List *);
@@ -0,0 +1,59 @@
+/**
+ * @file imhkernel.h
+ * @author Gibran Fuentes-Pineda <gibranfp@unam.mx>
+ * @date 2017
+ *
+ * @section GPL
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @brief Declaration of vectorized kernels for computing MinHash values
+ *        and generating random values
+ */
+#ifndef IMHKERNEL_H
+#define IMHKERNEL_H
+
+#include "array_lists.h"
+
+#define IMHKERNEL_SCALAR 0
+#define IMHKERNEL_AVX2 1
+#define IMHKERNEL_AVX512 2
+
+// constants of the SplitMix64 output function used to hash items
+#define IMHKERNEL_GAMMA 0x9E3779B97F4A7C15ULL
+#define IMHKERNEL_MIX1 0xBF58476D1CE4E5B9ULL
+#define IMHKERNEL_MIX2 0x94D049BB133111EBULL
+
+// size ratio from which intersections search the items of the small set in the large one
+#define IMHKERNEL_GALLOP_RATIO 32
+
+/************************ Function prototypes ************************/
+uint imhkernel_level(void);
+const char *imhkernel_name(uint);
+void imhkernel_minhash_hashed_scalar(List *, ullong *, uint, ullong *);
+void imhkernel_minhash_hashed_avx2(List *, ullong *, uint, ullong *);
+void imhkernel_minhash_hashed_avx512(List *, ullong *, uint, ullong *);
+void imhkernel_minhash_hashed(List *, ullong *, uint, ullong *);
+void imhkernel_minhash_ranks_scalar(List *, uint *, uint, uint, uint, ullong *);
+void imhkernel_minhash_ranks_avx2(List *, uint *, uint, uint, uint, ullong *);
+void imhkernel_minhash_ranks_avx512(List *, uint *, uint, uint, uint, ullong *);
+void imhkernel_minhash_ranks(List *, uint *, uint, uint, uint, ullong *);
+void imhkernel_fill_splitmix_scalar(ullong, ullong, uint, ullong *);
+void imhkernel_fill_splitmix_avx2(ullong, ullong, uint, ullong *);
+void imhkernel_fill_splitmix_avx512(ullong, ullong, uint, ullong *);
+void imhkernel_fill_splitmix(ullong, ullong, uint, ullong *);
+uint imhkernel_intersect_scalar(const uint *, uint, const uint *, uint);
+uint imhkernel_intersect_avx2(const uint *, uint, const uint *, uint);
+uint imhkernel_intersect_gallop(const uint *, uint, const uint *, uint);
+uint imhkernel_intersect_gallop_strided(const uint *, uint, const uint *, uint, uint);
+uint imhkernel_intersect_bitmap(const ullong *, uint, const uint *, uint);
+uint imhkernel_intersection_size(const uint *, uint, const uint *, uint);
+#endif
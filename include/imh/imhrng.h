@@ -0,0 +1,46 @@
+/**
+ * @file imhrng.h
+ * @author Gibran Fuentes-Pineda <gibranfp@unam.mx>
+ * @date 2017
+ *
+ * @section GPL
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @brief Declaration of a counter-based random number generator
+ */
+#ifndef IMHRNG_H
+#define IMHRNG_H
+
+#include "types.h"
+
+/**
+ * @brief Stream of random values. The value at any position of a stream
+ *        is computed directly from its key, so a stream can be copied,
+ *        moved to any position and used by one thread without touching
+ *        the others.
+ */
+typedef struct RandomStream {
+     ullong key;
+     ullong position;
+} RandomStream;
+
+/************************ Function prototypes ************************/
+ullong imhrng_key(ullong, ullong);
+ullong imhrng_at(ullong, ullong, ullong);
+void imhrng_init(RandomStream *, ullong, ullong);
+void imhrng_seek(RandomStream *, ullong);
+ullong imhrng_next(RandomStream *);
+double imhrng_next_double(RandomStream *);
+void imhrng_fill(RandomStream *, ullong *, uint);
+void imhrng_fill_double(RandomStream *, double *, uint);
+RandomStream *imhrng_global(void);
+#endif
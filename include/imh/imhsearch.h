@@ -22,15 +22,92 @@
 
 #include <iminhash.h>
 
+#define IMHSEARCH_QUERY_CHUNK 16 // queries claimed at a time by each query thread
+#define IMHSEARCH_BATCH_SIZE 8192 // queries read, searched and saved at a time when streaming
+#define IMHSEARCH_CANDIDATES_PER_NEIGHBOR 10 // candidates reranked for each of the top k neighbors
+#define IMHSEARCH_BITMAP_WORDS 32768 // largest bitmap of the items of a query (256 KiB)
+#define IMHSEARCH_BITMAP_WORDS_PER_CANDIDATE 64 // bitmap words a reranked candidate pays for
+
+// what a pass over a database of lists does with each tuple
+#define IMHSEARCH_PASS_STORE 0
+#define IMHSEARCH_PASS_COUNT 1
+#define IMHSEARCH_PASS_FILL 2
+
+#define IMHSEARCH_MAGIC "IMHINDEX" // first bytes of a hash index file
+#define IMHSEARCH_VERSION 1
+#define IMHSEARCH_FILE_ALIGNMENT 64 // sections of a hash index file start at cache line boundaries
+#define IMHSEARCH_SIGNATURE_WORDS 8 // 64-bit words of the bit signature of each list (512 bits)
+#define IMHSEARCH_SIGNATURE_MIN_SIZE 32 // top-k reranking reads the signatures of lists with more items
+
 typedef struct HashIndex {
 	  uint number_of_tables;
+	  uint tuple_size;
+	  uint scheme;
+	  ullong *seeds;
+	  uint *ranks;
+	  uint rank_stride;
+	  uint number_of_lists;
 	  HashTable *hash_tables;
+	  ullong *signatures; // bit signature of each list (NULL if they were not built)
+	  void *mapping; // index file mapped in memory (NULL if the index was built)
+	  ullong mapping_size;
 } HashIndex;
 
+/**
+ * @brief Header of a hash index file. It is followed by the sections of the
+ *        index (ranks, seeds and number of IDs of each table) and by the
+ *        sections of each table (a, b, permutations, keys, offsets and IDs),
+ *        each one aligned to IMHSEARCH_FILE_ALIGNMENT bytes. The bit
+ *        signatures of the lists, if any, come last, so files without
+ *        them (signature_words is 0) are still valid.
+ */
+typedef struct HashIndexHeader {
+     char magic[8];
+     uint version;
+     uint number_of_tables;
+     uint tuple_size;
+     uint scheme;
+     uint table_size;
+     uint dim;
+     uint sublist_size;
+     uint rank_stride;
+     uint number_of_lists;
+     uint number_of_seeds;
+     ullong signature_words;
+     ullong reserved[1];
+} HashIndexHeader;
+
 void imhsearch_print_index_head(HashIndex *);
 void imhsearch_print_index_tables(HashIndex *);
-HashIndex imhsearch_build(ListDB *, uint, uint, uint, uint);
+void imhsearch_init_index(HashIndex *);
+HashIndex imhsearch_build(ListDB *, uint, uint, uint, uint, uint);
+HashIndex imhsearch_build_parallel(ListDB *, uint, uint, uint, uint, uint, uint);
+void imhsearch_build_signatures(HashIndex *, ListDB *);
+void imhsearch_destroy(HashIndex *);
+void imhsearch_freeze(HashIndex *);
+void imhsearch_save_index(char *, HashIndex *);
+HashIndex imhsearch_load_index(char *);
+void imhsearch_compute_minhashes(List *, HashIndex *, ullong *);
+void imhsearch_compute_minhashes_range(List *, HashIndex *, uint, uint, ullong *);
+void imhsearch_store_listdb(ListDB *, uint, ullong, HashIndex *);
+void imhsearch_store_listdb_range(ListDB *, uint, ullong, HashIndex *, uint, uint);
+void imhsearch_count_listdb_range(ListDB *, uint, ullong, HashIndex *, uint, uint);
+void imhsearch_pass_listdb_range(ListDB *, uint, ullong, HashIndex *, uint, uint, uint);
 List imhsearch_query(List *, HashIndex *);
+List imhsearch_query_top(List *, HashIndex *, ListDB *, double (*)(List *, List *), uint, uint,
+                         double *);
+List imhsearch_query_threshold(List *, HashIndex *, ListDB *, double (*)(List *, List *), double,
+                               double **);
 void imhsearch_sort_custom(List *, List *, ListDB *, double (*)(List *, List *));
+void imhsearch_sort_scored(List *, List *, ListDB *, double (*)(List *, List *), double *);
 ListDB imhsearch_query_multi(ListDB *, HashIndex *);
+ListDB imhsearch_query_parallel(ListDB *, HashIndex *, ListDB *, double (*)(List *, List *), uint);
+ListDB imhsearch_query_scored(ListDB *, HashIndex *, ListDB *, double (*)(List *, List *), uint,
+                              double **);
+ListDB imhsearch_query_top_parallel(ListDB *, HashIndex *, ListDB *, double (*)(List *, List *),
+                                    uint, uint, double, uint, double **);
+void imhsearch_query_batch(ListDB *, HashIndex *, ListDB *, double (*)(List *, List *), uint,
+                           uint, double, uint, ListWriter *, int);
+ullong imhsearch_query_stream(ListReader *, uint, HashIndex *, ListDB *, double (*)(List *, List *),
+                              uint, uint, double, uint, ListWriter *, int);
 #endif
@@ -21,6 +21,17 @@
 #define IMINHASH_H
 
 #include "listdb.h"
+#include "imhrng.h"
+
+#define IMH_SCHEME_PERMUTATIONS 0 // dense array of random values per item and tuple position
+#define IMH_SCHEME_HASHED 1 // random values derived from a seeded hash of the item
+#define IMH_SCHEME_OPH 2 // one permutation hashing with optimal densification
+#define IMH_SCHEME_RANKS 3 // item-major store of 32-bit ranks shared by all tables
+
+#define IMH_NO_BUCKET 4294967295U // returned by lookups that find no bucket for a tuple
+
+#define IMH_RANKS_ALIGNMENT 64 // rows of the rank store start at cache line boundaries
+#define IMH_RNG_BLOCK 256 // random values drawn at a time when generating permutations
 
 typedef struct RandomValue
 {
@@ -38,9 +49,19 @@ typedef struct HashTable {
 	  uint tuple_size; 
 	  uint dim;
 	  uint sublist_size;
+	  uint scheme;
 	  RandomValue *permutations;
+	  ullong *seeds;
+	  uint number_of_bins;
+	  uint first_bin;
+	  uint *ranks;
+	  uint rank_stride;
 	  Bucket *buckets;
 	  List used_buckets;
+	  uint *keys;
+	  uint *offsets;
+	  uint *ids;
+	  uint *counts;
 	  uint *a;
 	  uint *b;
 } HashTable;
@@ -52,18 +73,51 @@ void imh_rng_init(unsigned long long);
 void imh_init_table(HashTable *);
 void imh_init_rng(unsigned long long);
 HashTable imh_create_table(uint, uint, uint, uint);
+HashTable imh_create_table_hashed(uint, uint, uint, uint);
+HashTable imh_create_table_oph(uint, uint, uint, uint, ullong, uint, uint);
+HashTable imh_create_table_ranks(uint, uint, uint, uint, uint *, uint, uint);
+HashTable imh_create_table_r(uint, uint, uint, uint, RandomStream *);
+HashTable imh_create_table_hashed_r(uint, uint, uint, uint, RandomStream *);
+HashTable imh_create_table_oph_r(uint, uint, uint, uint, ullong, uint, uint, RandomStream *);
+HashTable imh_create_table_ranks_r(uint, uint, uint, uint, uint *, uint, uint, RandomStream *);
+const char *imh_scheme_name(uint);
 void imh_destroy_table(HashTable *);
+void imh_freeze_table(HashTable *);
+void imh_start_counting(HashTable *);
+void imh_count_tuple(ullong *, HashTable *);
+void imh_start_filling(HashTable *);
+void imh_fill_tuple(ullong *, uint, HashTable *);
+void imh_finish_filling(HashTable *);
 int imh_random_double_value_compare(const void *, const void *);
 int imh_random_double_value_compare_back(const void *, const void *);
 int imh_random_int_value_compare(const void *, const void *);
 int imh_random_int_value_compare_back(const void *, const void *);
 void imh_generate_permutations(uint, uint, RandomValue *);
-ullong imh_compute_minhash(List *, RandomValue *);
+void imh_generate_permutations_r(uint, uint, RandomValue *, RandomStream *);
+uint imh_get_rank_stride(uint);
+uint *imh_create_ranks(uint, uint);
+void imh_generate_ranks(uint, uint, uint, uint *);
+void imh_generate_ranks_r(uint, uint, uint, uint, uint *, RandomStream *);
+void imh_pad_ranks(uint, uint, uint, uint *);
+ullong imh_hash_item(ullong, uint);
+ullong imh_compute_minhash_permutation(List *, RandomValue *);
+ullong imh_compute_minhash_hashed(List *, ullong);
+void imh_compute_oph(List *, ullong, uint, ullong *);
+void imh_compute_oph_range(List *, ullong, uint, uint, uint, ullong *);
+ullong imh_compute_minhash(List *, HashTable *, uint);
 int imh_random_value_double_compare_back(const void *, const void *);
+void imh_compute_tuple(List *, const HashTable *, ullong *);
+void imh_hash_tuple(ullong *, const HashTable *, uint *, uint *);
 void imh_compute_univhash(List *, HashTable *, uint *, uint *);
+uint imh_get_index_tuple(ullong *, HashTable *);
 uint imh_get_index(List *, HashTable *);
+uint imh_find_index_tuple(ullong *, const HashTable *);
+uint imh_find_index(List *, const HashTable *);
+void imh_append_bucket(List *, const HashTable *, uint);
 uint imh_get_sublist_numbers(ListDB *, uint, uint *);
+uint imh_split_list(List *, uint, RandomStream *, Item *, List *);
 ListDB imh_create_sublistdb_from_listdb(ListDB *, uint *, uint, uint, uint *);
+void imh_store_tuple(ullong *, uint, HashTable *);
 void imh_store_list(List *, uint, HashTable *);
 void imh_store_sublistdb(ListDB *, uint *, HashTable *);
 #endif
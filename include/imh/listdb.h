@@ -20,20 +20,76 @@
 #ifndef LISTDB_H
 #define LISTDB_H
 
+#include <stdio.h>
 #include "array_lists.h"
 
+#define LISTDB_BLOCK_SIZE 4194304 // bytes read at once when loading lists
+#define LISTDB_MAGIC "IMHLISTS" // first bytes of a binary list database file
+#define LISTDB_VERSION 1
+#define LISTDB_WRITE_BUFFER_SIZE 1048576 // bytes written at once when saving lists
+#define LISTDB_RESULTS_MAGIC "IMHRSLTS" // first bytes of a binary results file
+#define LISTDB_RESULTS_VERSION 1
+
 typedef struct ListDB{
      uint size;
      uint dim;
      List *lists;
+     ullong number_of_items; // number of items in the arena
+     Item *arena; // items of all the lists, one after the other (NULL if each list owns its items)
+     uint *item_column; // items of the arena without their frequencies (NULL unless split)
+     void *mapping; // binary file mapped in memory that holds the arena (NULL if none)
+     ullong mapping_size;
 }ListDB;
 
+/**
+ * @brief Header of a binary list database file. It is followed by the
+ *        offsets of the lists (size + 1 ullong values) and by their items.
+ */
+typedef struct ListDBHeader{
+     char magic[8];
+     uint version;
+     uint size;
+     uint dim;
+     uint item_size; // sizeof(Item) when the file was written
+     ullong number_of_items;
+     ullong reserved[4];
+}ListDBHeader;
+
+typedef struct ListReader{
+     FILE *file;
+     const char *name; // name of the input in error messages
+     char *buffer;
+     size_t capacity; // size of the buffer
+     size_t begin; // first byte that has not been parsed
+     size_t end; // end of the bytes read so far
+     ullong line; // line number of the first byte that has not been parsed
+     int eof;
+}ListReader;
+
+typedef struct ListWriter{
+     FILE *file;
+     const char *name; // name of the output in error messages
+     char *buffer;
+     size_t size; // bytes in the buffer
+}ListWriter;
+
+/**
+ * @brief Record of a binary results file: a neighbor and its score
+ */
+typedef struct ScoredItem{
+     uint item;
+     float score;
+}ScoredItem;
+
 /************************ Function prototypes ************************/
 void listdb_init(ListDB *);
 ListDB listdb_create(uint, uint);
 ListDB listdb_random(uint, uint, uint);
 void listdb_clear(ListDB *);
 void listdb_destroy(ListDB *);
+void listdb_pack(ListDB *);
+void listdb_split_columns(ListDB *);
+const uint *listdb_item_column(ListDB *, uint);
 void listdb_print(ListDB *);
 void listdb_print_multi(ListDB *, List *);
 void listdb_print_range(ListDB *, uint, uint);
@@ -62,6 +118,20 @@ void listdb_insert(ListDB *, List *, uint);
 void listdb_append(ListDB *, ListDB *);
 void listdb_append_lists_delete(ListDB *, uint, uint);
 void listdb_append_lists_destroy(ListDB *, uint, uint);
+void listdb_reader_open(ListReader *, FILE *, const char *);
+void listdb_reader_close(ListReader *);
+ListDB listdb_read(ListReader *, uint);
 ListDB listdb_load_from_file(char *);
+ListDB listdb_load_from_file_parallel(char *, uint);
+int listdb_is_binary_file(char *);
+ListDB listdb_load_from_binary_file(char *);
+void listdb_save_to_binary_file(char *, ListDB *);
 void listdb_save_to_file(char *, ListDB *);
+void listdb_save_scored_to_file(char *, ListDB *, double **);
+void listdb_writer_open(ListWriter *, FILE *, const char *);
+void listdb_writer_flush(ListWriter *);
+void listdb_writer_close(ListWriter *);
+void listdb_write_list(ListWriter *, List *);
+void listdb_write_results_header(ListWriter *);
+void listdb_write_scored_list(ListWriter *, List *, double *);
 #endif
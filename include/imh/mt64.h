@@ -53,8 +53,13 @@
    email: m-mat @ math.sci.hiroshima-u.ac.jp (remove spaces)
 */
 
+/*
+   The functions below keep the MT19937-64 interface, but they now draw
+   their values from the global stream of imhrng (see imhrng.h), so the
+   programs that still use them share the seed of imh_init_rng.
+*/
 
-/* initializes mt[NN] with a seed */
+/* initializes the global stream with a seed */
 void init_genrand64(unsigned long long seed);
 
 /* initialize by an array with array-length */
@@ -23,15 +23,20 @@
 #include <inttypes.h>
 #include <float.h>
 #include "array_lists.h"
+#include "imhkernel.h"
 
 /**
- * @brief Initializes a list
+ * @brief Initializes a list.
+ *        A list owns its items when its capacity is not zero. Otherwise its
+ *        items (if any) belong to someone else, e.g. the arena of a database,
+ *        and are copied before the list grows.
  *
  * @param list List to be initialized
  */
 void list_init(List *list)
 {
      list->size = 0;
+     list->capacity = 0;
      list->data = NULL;
 }
 
@@ -46,8 +51,10 @@ List list_create(uint size)
 {
      List list;
 
+     list_init(&list);
+     list_reserve(&list, size);
+     memset(list.data, 0, size * sizeof(Item));
      list.size = size;
-     list.data = (Item *) calloc(size, sizeof(Item));
 
      return list;
 }
@@ -68,6 +75,7 @@ List list_random(uint max_size, uint max_item)
      Item random_item;
 
      list_init(&list);
+     list_reserve(&list, random_size);
      for (i = 0; i < random_size; i++) {
           random_item.item = rand() % max_item;
           random_item.freq = 1;
@@ -84,10 +92,73 @@ List list_random(uint max_size, uint max_item)
  */
 void list_destroy(List *list)
 {
-     free(list->data);
+     if (list->capacity > 0)
+          free(list->data);
      list_init(list);
 }
 
+/**
+ * @brief Makes room for at least a given number of items in a list
+ *        without changing its size. A list that does not own its items
+ *        (a view) gets a copy of them, with room for at least its size.
+ *
+ * @param list List where the room will be made
+ * @param capacity Number of items the list must be able to hold
+ */
+void list_reserve(List *list, uint capacity)
+{
+     if (list->capacity == 0 && list->data != NULL && capacity < list->size)
+          capacity = list->size;
+     if (capacity > list->capacity) {
+          if (list->capacity == 0 && list->data != NULL) { // items are not owned
+               Item *data = (Item *) malloc(capacity * sizeof(Item));
+               if (data)
+                    memcpy(data, list->data, list->size * sizeof(Item));
+               list->data = data;
+          } else {
+               list->data = (Item *) realloc(list->data, capacity * sizeof(Item));
+          }
+          if (!list->data) {
+               fprintf(stderr,"Error: Could not allocate room for %u items\n", capacity);
+               exit(EXIT_FAILURE);
+          }
+          list->capacity = capacity;
+     }
+}
+
+/**
+ * @brief Releases the room of a list that is not used by its items
+ *
+ * @param list List to be shrunk
+ */
+void list_shrink_to_fit(List *list)
+{
+     if (list->size == 0) {
+          list_destroy(list);
+     } else if (list->size < list->capacity) {
+          list->data = (Item *) realloc(list->data, list->size * sizeof(Item));
+          list->capacity = list->size;
+     }
+}
+
+/**
+ * @brief Grows a list geometrically so that it can hold a given number of items
+ *
+ * @param list List to be grown
+ * @param needed Number of items the list must be able to hold
+ */
+void list_grow(List *list, uint needed)
+{
+     if (needed > list->capacity) {
+          uint capacity = list->capacity * 2;
+          if (capacity < LIST_MIN_CAPACITY)
+               capacity = LIST_MIN_CAPACITY;
+          if (capacity < needed)
+               capacity = needed;
+          list_reserve(list, capacity);
+     }
+}
+
 /**
  * @brief Makes an item
  *
@@ -452,11 +523,8 @@ void list_print_range(List *list, uint low, uint high)
  */
 void list_push(List *list, Item item)
 {
-     uint newsize = list->size + 1;
-
-     list->data = realloc(list->data, newsize * sizeof(Item));
-     list->data[list->size] = item;
-     list->size = newsize;
+     list_grow(list, list->size + 1);
+     list->data[list->size++] = item;
 }
 
 /**
@@ -470,11 +538,10 @@ void list_push(List *list, Item item)
 void list_push_range(List *list, List *items, uint low, uint high)
 {
      uint range = high - low + 1;
-     uint newsize = list->size + range;
 
-     list->data = realloc(list->data, newsize * sizeof(Item));
+     list_grow(list, list->size + range);
      memcpy(list->data + list->size, items->data + low, range * sizeof(Item));
-     list->size = newsize;
+     list->size += range;
 }
 
 /**
@@ -485,7 +552,6 @@ void list_push_range(List *list, List *items, uint low, uint high)
 void list_pop(List *list)
 {
      list->size--;
-     list->data = realloc(list->data, list->size * sizeof(Item));
 }
 
 /**
@@ -497,7 +563,6 @@ void list_pop(List *list)
 void list_pop_multi(List *list, uint number)
 {
      list->size -= number;
-     list->data = realloc(list->data, list->size * sizeof(Item));
 }
 
 /**
@@ -509,7 +574,6 @@ void list_pop_multi(List *list, uint number)
 void list_pop_until(List *list, uint last)
 {
      list->size = last;
-     list->data = realloc(list->data, list->size * sizeof(Item));
 }
 
 /**
@@ -520,15 +584,9 @@ void list_pop_until(List *list, uint last)
  */
 void list_delete_position(List *list, uint position)
 {
-     uint newsize = list->size - 1;
-     Item *tmpdata = (Item *) malloc(newsize * sizeof(Item));
-
-     memcpy(tmpdata, list->data, position * sizeof(Item));
-     memcpy(tmpdata + position, list->data + position + 1,
-            (newsize - position) * sizeof(Item));
-     free(list->data);
-     list->data = tmpdata;
-     list->size = newsize;
+     list->size--;
+     memmove(list->data + position, list->data + position + 1,
+             (list->size - position) * sizeof(Item));
 }
 
 /**
@@ -541,18 +599,8 @@ void list_delete_item(List *list, Item item)
 {
      Item *found = list_binary_search(list, item);
 
-     if (found != NULL) {
-          uint position = (uint)(found - list->data);
-          uint newsize = list->size - 1;
-          Item *tmpdata = (Item *) malloc(newsize * sizeof(Item));
-
-          memcpy(tmpdata, list->data, position * sizeof(Item));
-          memcpy(tmpdata + position, list->data + position + 1,
-                 (list->size - position - 1) * sizeof(Item));
-          free(list->data);
-          list->data = tmpdata;
-          list->size = newsize;
-     }
+     if (found != NULL)
+          list_delete_position(list, (uint)(found - list->data));
 }
 
 /**
@@ -564,16 +612,9 @@ void list_delete_item(List *list, Item item)
  */
 void list_delete_range(List *list, uint low, uint high)
 {
-     uint range = high - low + 1;
-     uint newsize = list->size - range;
-     Item *tmpdata = (Item *) malloc(newsize* sizeof(Item));
-
-     memcpy(tmpdata, list->data, low * sizeof(Item));
-     memcpy(tmpdata + low, list->data + high + 1,
-            (list->size - high - 1) * sizeof(Item));
-     free(list->data);
-     list->data = tmpdata;
-     list->size = newsize;
+     memmove(list->data + low, list->data + high + 1,
+             (list->size - high - 1) * sizeof(Item));
+     list->size -= high - low + 1;
 }
 
 /**
@@ -621,20 +662,16 @@ void list_delete_more_frequent(List *list, uint max_freq)
  */
 void list_unique(List *list)
 {
-     uint i;
+     uint i, last = 0;
 
      if (list->size > 0) {
-          for (i = 0; i < list->size - 1; i++) {
-               if (list->data[i].item == list->data[i + 1].item) {
-                    int k = 1;
-                    while(i + k < list->size &&
-                          list->data[i].item == list->data[i + k].item) {
-                         list->data[i].freq += list->data[i + k].freq;
-                         k++;
-                    }
-                    list_delete_range(list, i + 1, i + k - 1);
-               }
+          for (i = 1; i < list->size; i++) {
+               if (list->data[i].item == list->data[last].item)
+                    list->data[last].freq += list->data[i].freq;
+               else
+                    list->data[++last] = list->data[i];
           }
+          list->size = last + 1;
      }
 }
 
@@ -647,17 +684,11 @@ void list_unique(List *list)
  */
 void list_insert(List *list, Item item, uint position)
 {
-     uint newsize = list->size + 1;
-     Item *tmpdata;
-
-     tmpdata = (Item *) malloc(newsize * sizeof(Item));
-     memcpy(tmpdata, list->data, (position + 1) * sizeof(Item));
-     tmpdata[position] = item;
-     memcpy(tmpdata + position + 1, list->data + position,
-            (list->size - position) * sizeof(Item));
-     free(list->data);
-     list->data = tmpdata;
-     list->size = newsize;
+     list_grow(list, list->size + 1);
+     memmove(list->data + position + 1, list->data + position,
+             (list->size - position) * sizeof(Item));
+     list->data[position] = item;
+     list->size++;
 }
 
 /**
@@ -671,7 +702,8 @@ List list_duplicate(List *src)
 {
      List duplicate;
 
-     duplicate.data = (Item *) malloc(src->size * sizeof(Item));
+     list_init(&duplicate);
+     list_reserve(&duplicate, src->size);
      memcpy(duplicate.data, src->data, src->size * sizeof(Item));
      duplicate.size = src->size;
 
@@ -692,7 +724,8 @@ List list_copy_range(List *src, uint low, uint high)
      List copy;
      uint range = high - low + 1;
 
-     copy.data = (Item *) malloc(range * sizeof(Item));
+     list_init(&copy);
+     list_reserve(&copy, range);
      memcpy(copy.data, src->data + low, range * sizeof(Item));
      copy.size = range;
 
@@ -712,7 +745,8 @@ List list_concat(List *list1, List *list2)
      uint newsize = list1->size + list2->size;
      List concat;
 
-     concat.data = (Item *) malloc(newsize * sizeof(Item));
+     list_init(&concat);
+     list_reserve(&concat, newsize);
      memcpy(concat.data, list1->data, list1->size * sizeof(Item));
      memcpy(concat.data + list1->size, list2->data, list2->size * sizeof(Item));
      concat.size = newsize;
@@ -728,11 +762,9 @@ List list_concat(List *list1, List *list2)
  */
 void list_append(List *list1, List *list2)
 {
-     uint newsize = list1->size + list2->size;
-
-     list1->data = realloc(list1->data, newsize * sizeof(Item));
+     list_grow(list1, list1->size + list2->size);
      memcpy(list1->data + list1->size, list2->data, list2->size * sizeof(Item));
-     list1->size = newsize;
+     list1->size += list2->size;
 }
 
 /**
@@ -762,44 +794,30 @@ List list_union(List *list1, List *list2)
      List union_list;
 
      list_init(&union_list);
+     list_reserve(&union_list, list1->size + list2->size);
+     Item *out = union_list.data;
      while (i < list1->size && j < list2->size) {
           if (list1->data[i].item == list2->data[j].item) {
-               Item new_item;
-               new_item.item = list1->data[i].item;
-               new_item.freq = max(list1->data[i].freq, list2->data[j].freq);
-               list_push(&union_list, new_item);
+               out->item = list1->data[i].item;
+               out->freq = max(list1->data[i].freq, list2->data[j].freq);
                i++;
                j++;
           } else if (list1->data[i].item < list2->data[j].item) {
-               Item new_item;
-               new_item.item = list1->data[i].item;
-               new_item.freq = list1->data[i].freq;
-               list_push(&union_list, new_item);
-               i++;
+               *out = list1->data[i++];
           } else {
-               Item new_item;
-               new_item.item = list2->data[j].item;
-               new_item.freq = list2->data[j].freq;
-               list_push(&union_list, new_item);
-               j++;
+               *out = list2->data[j++];
           }
+          out++;
      }
 
-     while (i < list1->size) {
-          Item new_item;
-          new_item.item = list1->data[i].item;
-          new_item.freq = list1->data[i].freq;
-          list_push(&union_list, new_item);
-          i++;
-     }
+     while (i < list1->size)
+          *out++ = list1->data[i++];
 
-     while (j < list2->size) {
-          Item new_item;
-          new_item.item = list2->data[j].item;
-          new_item.freq = list2->data[j].freq;
-          list_push(&union_list, new_item);
-          j++;
-     }
+     while (j < list2->size)
+          *out++ = list2->data[j++];
+
+     union_list.size = (uint)(out - union_list.data);
+     list_shrink_to_fit(&union_list);
 
      return union_list;
 }
@@ -858,12 +876,13 @@ List list_intersection(List *list1, List *list2)
      List intersection_list;
 
      list_init(&intersection_list);
+     list_reserve(&intersection_list, min(list1->size, list2->size));
+     Item *out = intersection_list.data;
      while (i < list1->size && j < list2->size) {
           if (list1->data[i].item == list2->data[j].item) {
-               Item new_item;
-               new_item.item = list1->data[i].item;
-               new_item.freq = min(list1->data[i].freq, list2->data[j].freq);
-               list_push(&intersection_list, new_item);
+               out->item = list1->data[i].item;
+               out->freq = min(list1->data[i].freq, list2->data[j].freq);
+               out++;
                i++;
                j++;
           } else if (list1->data[i].item < list2->data[j].item) {
@@ -873,11 +892,16 @@ List list_intersection(List *list1, List *list2)
           }
      }
 
+     intersection_list.size = (uint)(out - intersection_list.data);
+     list_shrink_to_fit(&intersection_list);
+
      return intersection_list;
 }
 
 /**
- * @brief Computes the size of the intersection of a pair of lists
+ * @brief Computes the size of the intersection of a pair of lists. Lists of
+ *        similar size are merged without branches and the items of a much
+ *        shorter list are searched in the longer one.
  *
  * @param list1 First list
  * @param list2 Second list
@@ -889,7 +913,69 @@ uint list_intersection_size(List *list1, List *list2)
      uint i = 0, j = 0;
      uint intersection_size = 0;
 
+     uint stride = sizeof(Item) / sizeof(uint);
+     if (list1->size > 0 && list2->size / list1->size >= IMHKERNEL_GALLOP_RATIO)
+          return imhkernel_intersect_gallop_strided(&list1->data[0].item, list1->size,
+                                                    &list2->data[0].item, list2->size, stride);
+     if (list2->size > 0 && list1->size / list2->size >= IMHKERNEL_GALLOP_RATIO)
+          return imhkernel_intersect_gallop_strided(&list2->data[0].item, list2->size,
+                                                    &list1->data[0].item, list1->size, stride);
+
      while (i < list1->size && j < list2->size) {
+          uint item1 = list1->data[i].item, item2 = list2->data[j].item;
+          intersection_size += item1 == item2;
+          i += item1 <= item2;
+          j += item2 <= item1;
+     }
+
+     return intersection_size;
+}
+
+/**
+ * @brief Computes the size of the intersection of a list and a sorted
+ *        column of items (items stored without their frequencies)
+ *
+ * @param list List
+ * @param items Column of items
+ * @param size Number of items in the column
+ *
+ * @return Size of the intersection
+ */
+uint list_intersection_size_column(List *list, const uint *items, uint size)
+{
+     uint i = 0, j = 0;
+     uint intersection_size = 0;
+
+     while (i < list->size && j < size) {
+          uint item = list->data[i].item;
+          intersection_size += item == items[j];
+          i += item <= items[j];
+          j += items[j] <= item;
+     }
+
+     return intersection_size;
+}
+
+/**
+ * @brief Computes the size of the intersection of a pair of lists, but
+ *        stops as soon as the items left cannot reach a given size
+ *
+ * @param list1 First list
+ * @param list2 Second list
+ * @param needed Smallest intersection size of interest
+ *
+ * @return Size of the intersection if it is at least needed, or a smaller
+ *         value otherwise
+ */
+uint list_intersection_size_bounded(List *list1, List *list2, uint needed)
+{
+     uint i = 0, j = 0;
+     uint intersection_size = 0;
+
+     while (i < list1->size && j < list2->size) {
+          uint left = min(list1->size - i, list2->size - j);
+          if (intersection_size + left < needed)
+               break;
           if (list1->data[i].item == list2->data[j].item) {
                intersection_size++;
                i++;
@@ -904,6 +990,42 @@ uint list_intersection_size(List *list1, List *list2)
      return intersection_size;
 }
 
+/**
+ * @brief Computes the size of the intersection of a list and a sorted
+ *        column of items, but stops as soon as the items left cannot reach
+ *        a given size
+ *
+ * @param list List
+ * @param items Column of items
+ * @param size Number of items in the column
+ * @param needed Smallest intersection size of interest
+ *
+ * @return Size of the intersection if it is at least needed, or a smaller
+ *         value otherwise
+ */
+uint list_intersection_size_column_bounded(List *list, const uint *items, uint size, uint needed)
+{
+     uint i = 0, j = 0;
+     uint intersection_size = 0;
+
+     while (i < list->size && j < size) {
+          uint left = min(list->size - i, size - j);
+          if (intersection_size + left < needed)
+               break;
+          if (list->data[i].item == items[j]) {
+               intersection_size++;
+               i++;
+               j++;
+          } else if (list->data[i].item < items[j]) {
+               i++;
+          } else {
+               j++;
+          }
+     }
+
+     return intersection_size;
+}
+
 /**
  * @brief Computes the difference of a pair of lists
  *
@@ -918,6 +1040,8 @@ List list_difference(List *list1, List *list2)
      List difference_list;
 
      list_init(&difference_list);
+     list_reserve(&difference_list, list1->size);
+     Item *out = difference_list.data;
      while (i < list1->size && j < list2->size) {
           if (list1->data[i].item == list2->data[j].item) {
                i++;
@@ -925,14 +1049,13 @@ List list_difference(List *list1, List *list2)
           } else if (list1->data[i].item > list2->data[j].item){
                j++;
           } else {
-               Item new_item;
-               new_item.item = list1->data[i].item;
-               new_item.freq = list1->data[i].freq;
-               list_push(&difference_list, new_item);
-               i++;
+               *out++ = list1->data[i++];
           }
      }
 
+     difference_list.size = (uint)(out - difference_list.data);
+     list_shrink_to_fit(&difference_list);
+
      return difference_list;
 }
 
@@ -33,13 +33,35 @@
 void usage(void)
 {
      printf("usage: imhcmd [OPTIONS]... [LISTDB_FILE] [QUERY_FILE] [OUTPUT_FILE]\n"
+            "       imhcmd [OPTIONS]... --save_index=INDEX_FILE [LISTDB_FILE]\n"
             "Performs nearest neighbor search on lists using Intersection Min-Hashing\n"
+            "QUERY_FILE and OUTPUT_FILE can be - to read queries from stdin and\n"
+            "write neighbors to stdout\n"
             "Options:\n"
             "       --help\t\t\tPrints this help\n"
             "   -r, --tuple_size[=3]\t\tNumber of hash values per tuple\n"
             "   -l, --number_of_tables[=50]\tNumber of tables in search index\n"
             "   -t, --table_size[=20(2^20)]\tNumber of buckets in hash table (powers of 2)\n"
-            "   -s, --subset_size[=3]\tSize of subsets to create from database of lists\n");
+            "   -s, --subset_size[=3]\tSize of subsets to create from database of lists\n"
+            "   -e, --seed[=123456]\t\tSeed for the random number generator\n"
+            "   -m, --scheme[=permutations]\tHow MinHash random values are generated\n"
+            "\t\t\t\t(permutations, hashed, oph or ranks)\n"
+            "   -p, --threads[=0]\t\tNumber of threads used for loading, building and querying\n"
+            "\t\t\t\t(0 uses all online processors)\n"
+            "   -o, --save_index=FILE\tSaves the built index in a file\n"
+            "   -i, --load_index=FILE\tLoads the index from a file instead of building it\n"
+            "\t\t\t\t(-r, -l, -t, -s, -e and -m are taken from the file)\n"
+            "   -b, --binary_output\t\tSaves each neighbor with its overlap in a binary file\n"
+            "   -q, --batch_size[=8192]\tNumber of queries read, searched and saved at a time\n"
+            "   -k, --top_k=K\t\tSaves only the K neighbors with largest overlap\n"
+            "   -c, --candidates[=10*K]\tNumber of candidates with most collisions\n"
+            "\t\t\t\twhose overlap is computed (with -k)\n"
+            "   -T, --threshold=T\t\tSaves only the neighbors whose overlap is at least T\n"
+            "   -x, --split_columns\t\tKeeps a copy of the items of the database without their\n"
+            "\t\t\t\tfrequencies to compute overlaps faster (4 more bytes per item)\n"
+            "   -g, --signatures\t\tBuilds a 512-bit signature of each list to skip candidates\n"
+            "\t\t\t\tof -k and -T without computing their overlap (64 bytes per list,\n"
+            "\t\t\t\tsaved with the index)\n");
 }
 
 /**
@@ -54,7 +76,17 @@ int main(int argc, char **argv)
      uint table_size = 1048576; // default table size
      uint sublist_size = 3; // default sublist size
      unsigned long long seed = 123456; // default seed
+     uint scheme = IMH_SCHEME_PERMUTATIONS; // default MinHash scheme
+     uint number_of_threads = 0; // default number of threads (all processors)
      char *listdb_file, *query_file, *output; 
+     char *save_index = NULL, *load_index = NULL;
+     int binary_output = 0;
+     uint batch_size = IMHSEARCH_BATCH_SIZE; // default number of queries in memory
+     uint k = 0; // default number of neighbors (all)
+     uint number_of_candidates = 0; // default number of reranked candidates (10 * k)
+     double threshold = 0.0; // default smallest overlap of the neighbors (all)
+     int split_columns = 0;
+     int signatures = 0;
      
      int op;
      int option_index = 0;
@@ -67,11 +99,22 @@ int main(int argc, char **argv)
                {"table_size", required_argument, 0, 't'},
                {"sublist_size", required_argument, 0, 's'},
                {"seed", required_argument, 0, 'e'},
+               {"scheme", required_argument, 0, 'm'},
+               {"threads", required_argument, 0, 'p'},
+               {"save_index", required_argument, 0, 'o'},
+               {"load_index", required_argument, 0, 'i'},
+               {"binary_output", no_argument, 0, 'b'},
+               {"batch_size", required_argument, 0, 'q'},
+               {"top_k", required_argument, 0, 'k'},
+               {"candidates", required_argument, 0, 'c'},
+               {"threshold", required_argument, 0, 'T'},
+               {"split_columns", no_argument, 0, 'x'},
+               {"signatures", no_argument, 0, 'g'},
                {0, 0, 0, 0}
           };
 
      //Command-line option parser
-     while((op = getopt_long( argc, argv, "hr:l:t:s:e:", long_options, 
+     while((op = getopt_long( argc, argv, "hr:l:t:s:e:m:p:o:i:bq:k:c:T:xg", long_options, 
                               &option_index)) != -1){
           int this_option_optind = optind ? optind : 1;
           switch (op)
@@ -95,7 +138,57 @@ int main(int argc, char **argv)
                sublist_size = atoi(optarg);
                break;
           case 'e':
-               sublist_size = (unsigned long long) atoll(optarg);
+               seed = (unsigned long long) atoll(optarg);
+               break;
+          case 'm':
+               if (strcmp(optarg, "permutations") == 0) {
+                    scheme = IMH_SCHEME_PERMUTATIONS;
+               } else if (strcmp(optarg, "hashed") == 0) {
+                    scheme = IMH_SCHEME_HASHED;
+               } else if (strcmp(optarg, "oph") == 0) {
+                    scheme = IMH_SCHEME_OPH;
+               } else if (strcmp(optarg, "ranks") == 0) {
+                    scheme = IMH_SCHEME_RANKS;
+               } else {
+                    fprintf(stderr,"Error: Unknown scheme %s.\n"
+                            "Try `imhcmd --help' for more information.\n", optarg);
+                    exit(EXIT_FAILURE);
+               }
+               break;
+          case 'p':
+               number_of_threads = atoi(optarg);
+               break;
+          case 'o':
+               save_index = optarg;
+               break;
+          case 'i':
+               load_index = optarg;
+               break;
+          case 'b':
+               binary_output = 1;
+               break;
+          case 'q':
+               batch_size = atoi(optarg);
+               if (batch_size == 0) {
+                    fprintf(stderr,"Error: The batch size must be positive.\n"
+                            "Try `imhcmd --help' for more information.\n");
+                    exit(EXIT_FAILURE);
+               }
+               break;
+          case 'k':
+               k = atoi(optarg);
+               break;
+          case 'c':
+               number_of_candidates = atoi(optarg);
+               break;
+          case 'T':
+               threshold = atof(optarg);
+               break;
+          case 'x':
+               split_columns = 1;
+               break;
+          case 'g':
+               signatures = 1;
                break;
           case '?':
                fprintf(stderr,"Error: Unknown options.\n"
@@ -105,39 +198,128 @@ int main(int argc, char **argv)
                abort ();
           }
      }
-     if (optind + 3 == argc){
+     if (number_of_candidates < k)
+          number_of_candidates = number_of_candidates == 0 ? IMHSEARCH_CANDIDATES_PER_NEIGHBOR * k : k;
+
+     if (optind + 3 == argc || (save_index && optind + 1 == argc)){
+          // progress messages must not mix with neighbors written to stdout
+          FILE *log = optind + 3 == argc && strcmp(argv[argc - 1], "-") == 0 ? stderr : stdout;
           imh_init_rng(seed);
 
           listdb_file = argv[optind++];
-          query_file = argv[optind++];
-          output = argv[optind++];
 
-          printf("Reading database of lists from %s . . .\n", listdb_file);
-          ListDB listdb = listdb_load_from_file(listdb_file);
-          printf("Number of lists: %d\nDimensionality: %d\n", listdb.size, listdb.dim);
+          fprintf(log, "Reading database of lists from %s . . .\n", listdb_file);
+          ListDB listdb = listdb_load_from_file_parallel(listdb_file, number_of_threads);
+          fprintf(log, "Number of lists: %d\nDimensionality: %d\n", listdb.size, listdb.dim);
 
-          printf("Reading queries from %s . . .\n", query_file);
-          ListDB queries = listdb_load_from_file(query_file);
+          HashIndex hash_index;
+          if (load_index) {
+               fprintf(log, "Loading hash index from %s\n", load_index);
+               hash_index = imhsearch_load_index(load_index);
+               if (signatures && hash_index.signatures == NULL)
+                    fprintf(log, "%s was saved without signatures, so they are not used\n",
+                            load_index);
+               if (hash_index.number_of_lists != listdb.size) {
+                    fprintf(stderr,"Error: The index was built for %u lists, but %s has %u lists.\n",
+                            hash_index.number_of_lists, listdb_file, listdb.size);
+                    exit(EXIT_FAILURE);
+               }
+          } else {
+               fprintf(log, "Creating hash index with %u tables "
+                      "(tuple size = %u, table size = %u, sublist size = %u, scheme = %s)\n",
+                      number_of_tables, tuple_size, table_size, sublist_size,
+                      imh_scheme_name(scheme));
+               hash_index = imhsearch_build_parallel(&listdb,
+                                                     number_of_tables,
+                                                     tuple_size,
+                                                     table_size,
+                                                     sublist_size,
+                                                     scheme,
+                                                     number_of_threads);
+               if (signatures) {
+                    fprintf(log, "Building the signatures of the lists\n");
+                    imhsearch_build_signatures(&hash_index, &listdb);
+               }
+          }
 
-          printf("Creating hash index with %u tables "
-                 "(tuple size = %u, table size = %u, sublist size = %u)\n",
-                 number_of_tables, tuple_size, table_size, sublist_size);
-          HashIndex hash_index = imhsearch_build(&listdb,
-                                                 number_of_tables,
-                                                 tuple_size,
-                                                 table_size,
-                                                 sublist_size);
+          if (save_index) {
+               fprintf(log, "Saving hash index in %s\n", save_index);
+               imhsearch_save_index(save_index, &hash_index);
+          }
 
-          printf("Searching for neighbors\n");
-          ListDB neighbors = imhsearch_query_multi(&queries, &hash_index);
+          if (optind + 2 == argc) {
+               query_file = argv[optind++];
+               output = argv[optind++];
 
-          printf("Sorting neighbors by overlap\n");
-          uint i;
-          for (i = 0; i < neighbors.size; i++) 
-               imhsearch_sort_custom(&queries.lists[i], &neighbors.lists[i], &listdb, list_overlap);
+               FILE *input = stdin, *out = stdout;
+               if (strcmp(query_file, "-") != 0 && !(input = fopen(query_file, "r"))) {
+                    fprintf(stderr,"Error: Could not open file %s\n", query_file);
+                    exit(EXIT_FAILURE);
+               }
+               if (strcmp(output, "-") != 0 && !(out = fopen(output, "wb"))) {
+                    fprintf(stderr,"Error: Could not create file %s\n", output);
+                    exit(EXIT_FAILURE);
+               }
 
-          printf("Saving neighbors in %s\n", output);
-          listdb_save_to_file(output, &neighbors);
+               // overlap only needs the items of each list, but a mapped database
+               // is read from the shared pages of its file instead of being copied
+               if (split_columns && listdb.mapping != NULL)
+                    fprintf(log, "The items of %s are read from the mapped file "
+                            "instead of being split\n", listdb_file);
+               else if (split_columns)
+                    listdb_split_columns(&listdb);
+
+               ListWriter writer;
+               listdb_writer_open(&writer, out, output);
+               if (binary_output)
+                    listdb_write_results_header(&writer);
+
+               if (threshold > 0.0)
+                    fprintf(log, "Searching for the neighbors with overlap of at least %g of the "
+                            "queries in %s\n", threshold, query_file);
+               else if (k > 0)
+                    fprintf(log, "Searching for the %u neighbors with largest overlap of the queries "
+                            "in %s (among %u candidates)\n", k, query_file, number_of_candidates);
+               else
+                    fprintf(log, "Searching for neighbors of the queries in %s and sorting them by overlap\n",
+                            query_file);
+               fprintf(log, "Saving neighbors in %s\n", output);
+               fflush(log);
+               ullong number_of_queries;
+               if (input != stdin && listdb_is_binary_file(query_file)) {
+                    // a binary file is mapped, so only its batches are read into memory
+                    ListDB queries = listdb_load_from_binary_file(query_file);
+                    uint first;
+                    for (first = 0; first < queries.size; first += batch_size) {
+                         ListDB batch = queries;
+                         batch.lists = queries.lists + first;
+                         batch.size = min(batch_size, queries.size - first);
+                         imhsearch_query_batch(&batch, &hash_index, &listdb, list_overlap, k,
+                                               number_of_candidates, threshold,
+                                               number_of_threads, &writer, binary_output);
+                    }
+                    number_of_queries = queries.size;
+                    listdb_destroy(&queries);
+               } else {
+                    ListReader reader;
+                    listdb_reader_open(&reader, input, query_file);
+                    number_of_queries = imhsearch_query_stream(&reader, batch_size, &hash_index,
+                                                               &listdb, list_overlap, k,
+                                                               number_of_candidates, threshold,
+                                                               number_of_threads, &writer,
+                                                               binary_output);
+                    listdb_reader_close(&reader);
+               }
+               listdb_writer_close(&writer);
+               fprintf(log, "Number of queries: %llu\n", number_of_queries);
+
+               if (input != stdin)
+                    fclose(input);
+               if (out != stdout && fclose(out)) {
+                    fprintf(stderr,"Error: Could not close file %s\n", output);
+                    exit(EXIT_FAILURE);
+               }
+          }
      } else {
           if (optind + 3 > argc)
                fprintf(stderr, "Error: Missing arguments.\n"
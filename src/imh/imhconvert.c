@@ -0,0 +1,114 @@
+/**
+ * @file imhconvert.c 
+ * @author Gibran Fuentes-Pineda <gibranfp@unam.mx>
+ * @date 2017
+ *
+ * @section GPL
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @brief This program converts databases of lists between the text and binary formats
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include "listdb.h"
+
+/**
+ * @brief Prints help in screen.
+ */
+void usage(void)
+{
+     printf("usage: imhconvert [OPTIONS]... [INPUT_FILE] [OUTPUT_FILE]\n"
+            "Converts a database of lists from the text format to the binary format\n"
+            "(the input can be in either format)\n"
+            "Options:\n"
+            "       --help\t\t\tPrints this help\n"
+            "   -x, --text\t\t\tWrites the text format instead\n"
+            "   -p, --threads[=0]\t\tNumber of threads used for loading\n"
+            "\t\t\t\t(0 uses all online processors)\n");
+}
+
+/**
+ * ======================================================
+ * @brief Main function
+ * ======================================================
+ */
+int main(int argc, char **argv)
+{     
+     int text = 0; // writes the binary format by default
+     uint number_of_threads = 0; // default number of threads (all processors)
+     char *input, *output; 
+     
+     int op;
+     int option_index = 0;
+     
+     static struct option long_options[] =
+          {
+               {"help", no_argument, 0, 'h'},
+               {"text", no_argument, 0, 'x'},
+               {"threads", required_argument, 0, 'p'},
+               {0, 0, 0, 0}
+          };
+
+     //Command-line option parser
+     while((op = getopt_long( argc, argv, "hxp:", long_options, 
+                              &option_index)) != -1){
+          switch (op)
+          {
+          case 0:
+               break;
+          case 'h':
+               usage();
+               exit(EXIT_SUCCESS);
+               break;
+          case 'x':
+               text = 1;
+               break;
+          case 'p':
+               number_of_threads = atoi(optarg);
+               break;
+          case '?':
+               fprintf(stderr,"Error: Unknown options.\n"
+                       "Try `imhconvert --help' for more information.\n");
+               exit(EXIT_FAILURE);
+          default:
+               abort ();
+          }
+     }
+
+     if (optind + 2 == argc){
+          input = argv[optind++];
+          output = argv[optind++];
+
+          printf("Reading database of lists from %s . . .\n", input);
+          ListDB listdb = listdb_load_from_file_parallel(input, number_of_threads);
+          printf("Number of lists: %d\nDimensionality: %d\n", listdb.size, listdb.dim);
+
+          printf("Saving database of lists in %s (%s format)\n", output, text ? "text" : "binary");
+          if (text)
+               listdb_save_to_file(output, &listdb);
+          else
+               listdb_save_to_binary_file(output, &listdb);
+
+          listdb_destroy(&listdb);
+     } else {
+          if (optind + 2 > argc)
+               fprintf(stderr, "Error: Missing arguments.\n"
+                       "Try `imhconvert --help' for more information.\n");
+          else
+               fprintf(stderr, "Error: Unknown arguments.\n"
+                       "Try `imhconvert --help' for more information.\n");
+          exit(EXIT_FAILURE);
+     }
+
+     return 0;
+}
@@ -0,0 +1,755 @@
+/**
+ * @file imhkernel.c
+ * @author Gibran Fuentes-Pineda <gibranfp@unam.mx>
+ * @date 2017
+ *
+ * @section GPL
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @brief Vectorized kernels for computing MinHash values. Every kernel
+ *        computes all the requested MinHash values in one sweep over the
+ *        items of a list and gives exactly the same values as the scalar
+ *        one, so the kernel can be picked at runtime.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "imhkernel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define IMHKERNEL_X86
+#endif
+
+#define IMHKERNEL_VECTORS 4 // vector registers of minima kept per sweep
+
+/**
+ * @brief Output function of SplitMix64
+ *
+ * @param z Value to be mixed
+ *
+ * @return Mixed value
+ */
+static inline ullong imhkernel_mix(ullong z)
+{
+     z = (z ^ (z >> 30)) * IMHKERNEL_MIX1;
+     z = (z ^ (z >> 27)) * IMHKERNEL_MIX2;
+
+     return z ^ (z >> 31);
+}
+
+/**
+ * @brief Gets the best kernel supported by the processor
+ *
+ * @return IMHKERNEL_AVX512, IMHKERNEL_AVX2 or IMHKERNEL_SCALAR
+ */
+uint imhkernel_level(void)
+{
+#ifdef IMHKERNEL_X86
+     // the CPU model is filled in by libgcc before main, so this is only a read
+     if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+          return IMHKERNEL_AVX512;
+     else if (__builtin_cpu_supports("avx2"))
+          return IMHKERNEL_AVX2;
+#endif
+     return IMHKERNEL_SCALAR;
+}
+
+/**
+ * @brief Gets the name of a kernel
+ *
+ * @param level Kernel level
+ *
+ * @return Name of the kernel
+ */
+const char *imhkernel_name(uint level)
+{
+     switch (level) {
+     case IMHKERNEL_AVX512:
+          return "avx512";
+     case IMHKERNEL_AVX2:
+          return "avx2";
+     default:
+          return "scalar";
+     }
+}
+
+/**
+ * @brief Computes several hashed MinHash values of a list in one sweep
+ *        over its items (portable version).
+ *
+ * @param list List to be hashed
+ * @param seeds Seeds of the MinHash functions
+ * @param number_of_hashes Number of MinHash functions
+ * @param minhashes Computed MinHash values
+ */
+void imhkernel_minhash_hashed_scalar(List *list, ullong *seeds,
+                                     uint number_of_hashes, ullong *minhashes)
+{
+     uint i, j;
+
+     for (j = 0; j < number_of_hashes; j++)
+          minhashes[j] = LARGEST_INT64;
+
+     for (i = 0; i < list->size; i++) {
+          ullong step = ((ullong) list->data[i].item + 1) * IMHKERNEL_GAMMA;
+          for (j = 0; j < number_of_hashes; j++) {
+               ullong hash = imhkernel_mix(seeds[j] + step);
+               if (minhashes[j] > hash)
+                    minhashes[j] = hash;
+          }
+     }
+}
+
+/**
+ * @brief Computes several MinHash values of a list from an item-major
+ *        store of 32-bit ranks in one sweep over its items (portable version).
+ *
+ * @param list List to be hashed
+ * @param ranks Rank store (one row of ranks per item)
+ * @param stride Number of ranks per row
+ * @param first First column of the rows to be used
+ * @param number_of_hashes Number of MinHash functions (columns)
+ * @param minhashes Computed MinHash values
+ */
+void imhkernel_minhash_ranks_scalar(List *list, uint *ranks, uint stride, uint first,
+                                    uint number_of_hashes, ullong *minhashes)
+{
+     uint i, j;
+
+     for (j = 0; j < number_of_hashes; j++)
+          minhashes[j] = LARGEST_INT;
+
+     for (i = 0; i < list->size; i++) {
+          uint *row = ranks + (size_t) list->data[i].item * stride + first;
+          for (j = 0; j < number_of_hashes; j++)
+               if (minhashes[j] > row[j])
+                    minhashes[j] = row[j];
+     }
+}
+
+/**
+ * @brief Fills an array with consecutive outputs of a SplitMix64 stream,
+ *        value j being the output at position position + j (portable version).
+ *
+ * @param key Key of the stream
+ * @param position Position of the first value
+ * @param number_of_values Number of values
+ * @param values Generated values
+ */
+void imhkernel_fill_splitmix_scalar(ullong key, ullong position, uint number_of_values,
+                                    ullong *values)
+{
+     uint j;
+
+     for (j = 0; j < number_of_values; j++)
+          values[j] = imhkernel_mix(key + (position + j + 1) * IMHKERNEL_GAMMA);
+}
+
+/**
+ * @brief Computes the size of the intersection of two sets of items given
+ *        as increasing arrays with a branchless merge (portable version).
+ *
+ * @param a First array of items
+ * @param size_a Number of items in the first array
+ * @param b Second array of items
+ * @param size_b Number of items in the second array
+ *
+ * @return Size of the intersection
+ */
+uint imhkernel_intersect_scalar(const uint *a, uint size_a, const uint *b, uint size_b)
+{
+     uint i = 0, j = 0, intersection_size = 0;
+
+     while (i < size_a && j < size_b) {
+          uint x = a[i], y = b[j];
+          intersection_size += x == y;
+          i += x <= y;
+          j += y <= x;
+     }
+
+     return intersection_size;
+}
+
+/**
+ * @brief Exponential search intersection of imhkernel_intersect_gallop and
+ *        imhkernel_intersect_gallop_strided, with the items of both arrays
+ *        stored every stride values
+ */
+static inline uint imhkernel_gallop(const uint *small, uint size_small,
+                                    const uint *large, uint size_large, uint stride)
+{
+     uint i, j = 0, intersection_size = 0;
+
+     for (i = 0; i < size_small && j < size_large; i++) {
+          uint x = small[(size_t) i * stride];
+          if (large[(size_t) j * stride] < x) {
+               // large[low] < x and large[high] >= x (or high is the end)
+               uint low = j, step = 1;
+               while (j + step < size_large && large[(size_t) (j + step) * stride] < x) {
+                    low = j + step;
+                    step <<= 1;
+               }
+               uint high = j + step < size_large ? j + step : size_large;
+               low++;
+               while (low < high) {
+                    uint middle = low + (high - low) / 2;
+                    if (large[(size_t) middle * stride] < x)
+                         low = middle + 1;
+                    else
+                         high = middle;
+               }
+               j = low;
+          }
+          if (j < size_large && large[(size_t) j * stride] == x) {
+               intersection_size++;
+               j++;
+          }
+     }
+
+     return intersection_size;
+}
+
+/**
+ * @brief Computes the size of the intersection of a small and a large set
+ *        of items given as increasing arrays. Each item of the small set is
+ *        searched in the large one with an exponential search that starts
+ *        where the previous one ended, so it takes O(m log(n / m)) time.
+ *
+ * @param small Array with the smallest number of items
+ * @param size_small Number of items in the small array
+ * @param large Array with the largest number of items
+ * @param size_large Number of items in the large array
+ *
+ * @return Size of the intersection
+ */
+uint imhkernel_intersect_gallop(const uint *small, uint size_small,
+                                const uint *large, uint size_large)
+{
+     return imhkernel_gallop(small, size_small, large, size_large, 1);
+}
+
+/**
+ * @brief Same as imhkernel_intersect_gallop for items interleaved with other
+ *        values, e.g. the items of an array of Item with a stride of
+ *        sizeof(Item) / sizeof(uint)
+ *
+ * @param small First item of the small set
+ * @param size_small Number of items in the small set
+ * @param large First item of the large set
+ * @param size_large Number of items in the large set
+ * @param stride Distance between consecutive items (in uint values)
+ *
+ * @return Size of the intersection
+ */
+uint imhkernel_intersect_gallop_strided(const uint *small, uint size_small,
+                                        const uint *large, uint size_large, uint stride)
+{
+     return imhkernel_gallop(small, size_small, large, size_large, stride);
+}
+
+/**
+ * @brief Computes the size of the intersection of a set of items given as a
+ *        bitmap and a set given as an increasing array, with one probe of the
+ *        bitmap per item of the array.
+ *
+ * @param bitmap Bitmap with a bit for each item up to max_item
+ * @param max_item Largest item of the bitmap
+ * @param items Array of items
+ * @param size Number of items in the array
+ *
+ * @return Size of the intersection
+ */
+uint imhkernel_intersect_bitmap(const ullong *bitmap, uint max_item, const uint *items, uint size)
+{
+     uint i, intersection_size = 0;
+
+     for (i = 0; i < size && items[i] <= max_item; i++)
+          intersection_size += (bitmap[items[i] >> 6] >> (items[i] & 63)) & 1;
+
+     return intersection_size;
+}
+
+#ifdef IMHKERNEL_X86
+/**
+ * @brief Multiplies 64-bit lanes by a constant whose low and high halves
+ *        are given in separate registers (AVX2 has no 64-bit multiply).
+ */
+__attribute__((target("avx2")))
+static inline __m256i imhkernel_mul64_avx2(__m256i a, __m256i b_lo, __m256i b_hi)
+{
+     __m256i lo = _mm256_mul_epu32(a, b_lo);
+     __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b_lo),
+                                      _mm256_mul_epu32(a, b_hi));
+
+     return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+}
+
+/**
+ * @brief Computes several hashed MinHash values of a list in one sweep
+ *        over its items (AVX2 version). The minima of 16 functions are kept
+ *        in registers at a time, flipped by the sign bit so that the signed
+ *        comparison of AVX2 orders them as unsigned values.
+ *
+ * @param list List to be hashed
+ * @param seeds Seeds of the MinHash functions
+ * @param number_of_hashes Number of MinHash functions
+ * @param minhashes Computed MinHash values
+ */
+__attribute__((target("avx2")))
+void imhkernel_minhash_hashed_avx2(List *list, ullong *seeds,
+                                   uint number_of_hashes, ullong *minhashes)
+{
+     uint i, j, k;
+     const __m256i sign = _mm256_set1_epi64x((long long) 0x8000000000000000ULL);
+     const __m256i mix1_lo = _mm256_set1_epi64x((long long) (IMHKERNEL_MIX1 & 0xFFFFFFFF));
+     const __m256i mix1_hi = _mm256_set1_epi64x((long long) (IMHKERNEL_MIX1 >> 32));
+     const __m256i mix2_lo = _mm256_set1_epi64x((long long) (IMHKERNEL_MIX2 & 0xFFFFFFFF));
+     const __m256i mix2_hi = _mm256_set1_epi64x((long long) (IMHKERNEL_MIX2 >> 32));
+     const __m256i lanes = _mm256_set_epi64x(3, 2, 1, 0);
+
+     for (j = 0; j < number_of_hashes; j += 4 * IMHKERNEL_VECTORS) {
+          __m256i mask[IMHKERNEL_VECTORS], seed[IMHKERNEL_VECTORS], mins[IMHKERNEL_VECTORS];
+
+          for (k = 0; k < IMHKERNEL_VECTORS; k++) {
+               long long remaining = (long long) number_of_hashes - (j + 4 * k);
+               mask[k] = _mm256_cmpgt_epi64(_mm256_set1_epi64x(remaining), lanes);
+               seed[k] = _mm256_maskload_epi64((const long long *) (seeds + j + 4 * k), mask[k]);
+               mins[k] = _mm256_set1_epi64x((long long) (LARGEST_INT64 >> 1));
+          }
+
+          for (i = 0; i < list->size; i++) {
+               __m256i step = _mm256_set1_epi64x((long long) (((ullong) list->data[i].item + 1)
+                                                              * IMHKERNEL_GAMMA));
+               for (k = 0; k < IMHKERNEL_VECTORS; k++) {
+                    __m256i z = _mm256_add_epi64(seed[k], step);
+                    z = _mm256_xor_si256(z, _mm256_srli_epi64(z, 30));
+                    z = imhkernel_mul64_avx2(z, mix1_lo, mix1_hi);
+                    z = _mm256_xor_si256(z, _mm256_srli_epi64(z, 27));
+                    z = imhkernel_mul64_avx2(z, mix2_lo, mix2_hi);
+                    z = _mm256_xor_si256(z, _mm256_srli_epi64(z, 31));
+                    z = _mm256_xor_si256(z, sign);
+                    mins[k] = _mm256_blendv_epi8(mins[k], z, _mm256_cmpgt_epi64(mins[k], z));
+               }
+          }
+
+          for (k = 0; k < IMHKERNEL_VECTORS; k++)
+               _mm256_maskstore_epi64((long long *) (minhashes + j + 4 * k), mask[k],
+                                      _mm256_xor_si256(mins[k], sign));
+     }
+}
+
+/**
+ * @brief Computes several hashed MinHash values of a list in one sweep
+ *        over its items (AVX-512 version). The minima of 32 functions are
+ *        kept in registers at a time.
+ *
+ * @param list List to be hashed
+ * @param seeds Seeds of the MinHash functions
+ * @param number_of_hashes Number of MinHash functions
+ * @param minhashes Computed MinHash values
+ */
+__attribute__((target("avx512f,avx512dq")))
+void imhkernel_minhash_hashed_avx512(List *list, ullong *seeds,
+                                     uint number_of_hashes, ullong *minhashes)
+{
+     uint i, j, k;
+     const __m512i mix1 = _mm512_set1_epi64((long long) IMHKERNEL_MIX1);
+     const __m512i mix2 = _mm512_set1_epi64((long long) IMHKERNEL_MIX2);
+
+     for (j = 0; j < number_of_hashes; j += 8 * IMHKERNEL_VECTORS) {
+          __mmask8 mask[IMHKERNEL_VECTORS];
+          __m512i seed[IMHKERNEL_VECTORS], mins[IMHKERNEL_VECTORS];
+
+          for (k = 0; k < IMHKERNEL_VECTORS; k++) {
+               int remaining = (int) number_of_hashes - (int) (j + 8 * k);
+               if (remaining >= 8)
+                    mask[k] = 0xFF;
+               else if (remaining > 0)
+                    mask[k] = (__mmask8) ((1U << remaining) - 1);
+               else
+                    mask[k] = 0;
+               seed[k] = _mm512_maskz_loadu_epi64(mask[k], seeds + j + 8 * k);
+               mins[k] = _mm512_set1_epi64(-1);
+          }
+
+          for (i = 0; i < list->size; i++) {
+               __m512i step = _mm512_set1_epi64((long long) (((ullong) list->data[i].item + 1)
+                                                             * IMHKERNEL_GAMMA));
+               for (k = 0; k < IMHKERNEL_VECTORS; k++) {
+                    __m512i z = _mm512_add_epi64(seed[k], step);
+                    z = _mm512_xor_si512(z, _mm512_srli_epi64(z, 30));
+                    z = _mm512_mullo_epi64(z, mix1);
+                    z = _mm512_xor_si512(z, _mm512_srli_epi64(z, 27));
+                    z = _mm512_mullo_epi64(z, mix2);
+                    z = _mm512_xor_si512(z, _mm512_srli_epi64(z, 31));
+                    mins[k] = _mm512_min_epu64(mins[k], z);
+               }
+          }
+
+          for (k = 0; k < IMHKERNEL_VECTORS; k++)
+               _mm512_mask_storeu_epi64(minhashes + j + 8 * k, mask[k], mins[k]);
+     }
+}
+
+/**
+ * @brief Computes several MinHash values of a list from an item-major
+ *        store of 32-bit ranks in one sweep over its items (AVX2 version).
+ *        The row of the next item is prefetched while the current one is
+ *        reduced.
+ *
+ * @param list List to be hashed
+ * @param ranks Rank store (one row of ranks per item)
+ * @param stride Number of ranks per row
+ * @param first First column of the rows to be used
+ * @param number_of_hashes Number of MinHash functions (columns)
+ * @param minhashes Computed MinHash values
+ */
+__attribute__((target("avx2")))
+void imhkernel_minhash_ranks_avx2(List *list, uint *ranks, uint stride, uint first,
+                                  uint number_of_hashes, ullong *minhashes)
+{
+     uint i, j, k, l;
+     const __m256i lanes = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+
+     for (j = 0; j < number_of_hashes; j += 8 * IMHKERNEL_VECTORS) {
+          __m256i mask[IMHKERNEL_VECTORS], mins[IMHKERNEL_VECTORS];
+
+          for (k = 0; k < IMHKERNEL_VECTORS; k++) {
+               int remaining = (int) number_of_hashes - (int) (j + 8 * k);
+               mask[k] = _mm256_cmpgt_epi32(_mm256_set1_epi32(remaining), lanes);
+               mins[k] = _mm256_set1_epi32(-1);
+          }
+
+          for (i = 0; i < list->size; i++) {
+               uint *row = ranks + (size_t) list->data[i].item * stride + first + j;
+               if (i + 1 < list->size)
+                    __builtin_prefetch(ranks + (size_t) list->data[i + 1].item * stride + first + j);
+               for (k = 0; k < IMHKERNEL_VECTORS; k++) {
+                    __m256i rank = _mm256_maskload_epi32((const int *) (row + 8 * k), mask[k]);
+                    mins[k] = _mm256_min_epu32(mins[k], rank);
+               }
+          }
+
+          for (k = 0; k < IMHKERNEL_VECTORS; k++) {
+               uint values[8];
+               _mm256_storeu_si256((__m256i *) values, mins[k]);
+               for (l = 0; l < 8 && j + 8 * k + l < number_of_hashes; l++)
+                    minhashes[j + 8 * k + l] = values[l];
+          }
+     }
+}
+
+/**
+ * @brief Computes several MinHash values of a list from an item-major
+ *        store of 32-bit ranks in one sweep over its items (AVX-512 version).
+ *
+ * @param list List to be hashed
+ * @param ranks Rank store (one row of ranks per item)
+ * @param stride Number of ranks per row
+ * @param first First column of the rows to be used
+ * @param number_of_hashes Number of MinHash functions (columns)
+ * @param minhashes Computed MinHash values
+ */
+__attribute__((target("avx512f")))
+void imhkernel_minhash_ranks_avx512(List *list, uint *ranks, uint stride, uint first,
+                                    uint number_of_hashes, ullong *minhashes)
+{
+     uint i, j, k;
+
+     for (j = 0; j < number_of_hashes; j += 16 * IMHKERNEL_VECTORS) {
+          __mmask16 mask[IMHKERNEL_VECTORS];
+          __m512i mins[IMHKERNEL_VECTORS];
+
+          for (k = 0; k < IMHKERNEL_VECTORS; k++) {
+               int remaining = (int) number_of_hashes - (int) (j + 16 * k);
+               if (remaining >= 16)
+                    mask[k] = 0xFFFF;
+               else if (remaining > 0)
+                    mask[k] = (__mmask16) ((1U << remaining) - 1);
+               else
+                    mask[k] = 0;
+               mins[k] = _mm512_set1_epi32(-1);
+          }
+
+          for (i = 0; i < list->size; i++) {
+               uint *row = ranks + (size_t) list->data[i].item * stride + first + j;
+               if (i + 1 < list->size)
+                    __builtin_prefetch(ranks + (size_t) list->data[i + 1].item * stride + first + j);
+               for (k = 0; k < IMHKERNEL_VECTORS; k++)
+                    mins[k] = _mm512_mask_min_epu32(mins[k], mask[k], mins[k],
+                                                    _mm512_maskz_loadu_epi32(mask[k], row + 16 * k));
+          }
+
+          for (k = 0; k < IMHKERNEL_VECTORS; k++) {
+               __m512i low = _mm512_cvtepu32_epi64(_mm512_castsi512_si256(mins[k]));
+               __m512i high = _mm512_cvtepu32_epi64(_mm512_extracti64x4_epi64(mins[k], 1));
+               _mm512_mask_storeu_epi64(minhashes + j + 16 * k, (__mmask8) mask[k], low);
+               _mm512_mask_storeu_epi64(minhashes + j + 16 * k + 8, (__mmask8) (mask[k] >> 8), high);
+          }
+     }
+}
+
+/**
+ * @brief Fills an array with consecutive outputs of a SplitMix64 stream
+ *        (AVX2 version). Four positions are mixed at a time.
+ *
+ * @param key Key of the stream
+ * @param position Position of the first value
+ * @param number_of_values Number of values
+ * @param values Generated values
+ */
+__attribute__((target("avx2")))
+void imhkernel_fill_splitmix_avx2(ullong key, ullong position, uint number_of_values,
+                                  ullong *values)
+{
+     uint j = 0;
+     const __m256i mix1_lo = _mm256_set1_epi64x((long long) (IMHKERNEL_MIX1 & 0xFFFFFFFF));
+     const __m256i mix1_hi = _mm256_set1_epi64x((long long) (IMHKERNEL_MIX1 >> 32));
+     const __m256i mix2_lo = _mm256_set1_epi64x((long long) (IMHKERNEL_MIX2 & 0xFFFFFFFF));
+     const __m256i mix2_hi = _mm256_set1_epi64x((long long) (IMHKERNEL_MIX2 >> 32));
+     const __m256i step = _mm256_set1_epi64x((long long) (4 * IMHKERNEL_GAMMA));
+     __m256i z0 = _mm256_set_epi64x((long long) (key + (position + 4) * IMHKERNEL_GAMMA),
+                                    (long long) (key + (position + 3) * IMHKERNEL_GAMMA),
+                                    (long long) (key + (position + 2) * IMHKERNEL_GAMMA),
+                                    (long long) (key + (position + 1) * IMHKERNEL_GAMMA));
+
+     for (; j + 4 <= number_of_values; j += 4) {
+          __m256i z = z0;
+          z = _mm256_xor_si256(z, _mm256_srli_epi64(z, 30));
+          z = imhkernel_mul64_avx2(z, mix1_lo, mix1_hi);
+          z = _mm256_xor_si256(z, _mm256_srli_epi64(z, 27));
+          z = imhkernel_mul64_avx2(z, mix2_lo, mix2_hi);
+          z = _mm256_xor_si256(z, _mm256_srli_epi64(z, 31));
+          _mm256_storeu_si256((__m256i *) (values + j), z);
+          z0 = _mm256_add_epi64(z0, step);
+     }
+
+     imhkernel_fill_splitmix_scalar(key, position + j, number_of_values - j, values + j);
+}
+
+/**
+ * @brief Fills an array with consecutive outputs of a SplitMix64 stream
+ *        (AVX-512 version). Eight positions are mixed at a time.
+ *
+ * @param key Key of the stream
+ * @param position Position of the first value
+ * @param number_of_values Number of values
+ * @param values Generated values
+ */
+__attribute__((target("avx512f,avx512dq")))
+void imhkernel_fill_splitmix_avx512(ullong key, ullong position, uint number_of_values,
+                                    ullong *values)
+{
+     uint j;
+     const __m512i mix1 = _mm512_set1_epi64((long long) IMHKERNEL_MIX1);
+     const __m512i mix2 = _mm512_set1_epi64((long long) IMHKERNEL_MIX2);
+     const __m512i gamma = _mm512_set1_epi64((long long) IMHKERNEL_GAMMA);
+     const __m512i step = _mm512_set1_epi64((long long) (8 * IMHKERNEL_GAMMA));
+     __m512i z0 = _mm512_add_epi64(_mm512_set1_epi64((long long) (key + position * IMHKERNEL_GAMMA)),
+                                   _mm512_mullo_epi64(_mm512_set_epi64(8, 7, 6, 5, 4, 3, 2, 1),
+                                                      gamma));
+
+     for (j = 0; j < number_of_values; j += 8) {
+          int remaining = (int) (number_of_values - j);
+          __mmask8 mask = remaining >= 8 ? 0xFF : (__mmask8) ((1U << remaining) - 1);
+          __m512i z = z0;
+          z = _mm512_xor_si512(z, _mm512_srli_epi64(z, 30));
+          z = _mm512_mullo_epi64(z, mix1);
+          z = _mm512_xor_si512(z, _mm512_srli_epi64(z, 27));
+          z = _mm512_mullo_epi64(z, mix2);
+          z = _mm512_xor_si512(z, _mm512_srli_epi64(z, 31));
+          _mm512_mask_storeu_epi64(values + j, mask, z);
+          z0 = _mm512_add_epi64(z0, step);
+     }
+}
+/**
+ * @brief Computes the size of the intersection of two sets of items given
+ *        as increasing arrays. Blocks of 8 items of each array are compared
+ *        all against all with 8 rotations and the block with the smallest
+ *        last item is skipped (AVX2 version).
+ *
+ * @param a First array of items
+ * @param size_a Number of items in the first array
+ * @param b Second array of items
+ * @param size_b Number of items in the second array
+ *
+ * @return Size of the intersection
+ */
+__attribute__((target("avx2")))
+uint imhkernel_intersect_avx2(const uint *a, uint size_a, const uint *b, uint size_b)
+{
+     uint i = 0, j = 0, k, intersection_size = 0;
+     const __m256i rotate = _mm256_set_epi32(0, 7, 6, 5, 4, 3, 2, 1);
+
+     while (i + 8 <= size_a && j + 8 <= size_b) {
+          __m256i block_a = _mm256_loadu_si256((const __m256i *) (a + i));
+          __m256i block_b = _mm256_loadu_si256((const __m256i *) (b + j));
+          __m256i equal = _mm256_cmpeq_epi32(block_a, block_b);
+          for (k = 1; k < 8; k++) {
+               block_b = _mm256_permutevar8x32_epi32(block_b, rotate);
+               equal = _mm256_or_si256(equal, _mm256_cmpeq_epi32(block_a, block_b));
+          }
+          intersection_size += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(equal)));
+
+          uint last_a = a[i + 7], last_b = b[j + 7];
+          i += last_a <= last_b ? 8 : 0;
+          j += last_b <= last_a ? 8 : 0;
+     }
+
+     return intersection_size + imhkernel_intersect_scalar(a + i, size_a - i, b + j, size_b - j);
+}
+#else
+void imhkernel_minhash_hashed_avx2(List *list, ullong *seeds,
+                                   uint number_of_hashes, ullong *minhashes)
+{
+     imhkernel_minhash_hashed_scalar(list, seeds, number_of_hashes, minhashes);
+}
+
+void imhkernel_minhash_hashed_avx512(List *list, ullong *seeds,
+                                     uint number_of_hashes, ullong *minhashes)
+{
+     imhkernel_minhash_hashed_scalar(list, seeds, number_of_hashes, minhashes);
+}
+
+void imhkernel_minhash_ranks_avx2(List *list, uint *ranks, uint stride, uint first,
+                                  uint number_of_hashes, ullong *minhashes)
+{
+     imhkernel_minhash_ranks_scalar(list, ranks, stride, first, number_of_hashes, minhashes);
+}
+
+void imhkernel_minhash_ranks_avx512(List *list, uint *ranks, uint stride, uint first,
+                                    uint number_of_hashes, ullong *minhashes)
+{
+     imhkernel_minhash_ranks_scalar(list, ranks, stride, first, number_of_hashes, minhashes);
+}
+
+void imhkernel_fill_splitmix_avx2(ullong key, ullong position, uint number_of_values,
+                                  ullong *values)
+{
+     imhkernel_fill_splitmix_scalar(key, position, number_of_values, values);
+}
+
+void imhkernel_fill_splitmix_avx512(ullong key, ullong position, uint number_of_values,
+                                    ullong *values)
+{
+     imhkernel_fill_splitmix_scalar(key, position, number_of_values, values);
+}
+
+uint imhkernel_intersect_avx2(const uint *a, uint size_a, const uint *b, uint size_b)
+{
+     return imhkernel_intersect_scalar(a, size_a, b, size_b);
+}
+#endif
+
+/**
+ * @brief Computes several hashed MinHash values of a list in one sweep
+ *        over its items with the best kernel supported by the processor.
+ *
+ * @param list List to be hashed
+ * @param seeds Seeds of the MinHash functions
+ * @param number_of_hashes Number of MinHash functions
+ * @param minhashes Computed MinHash values
+ */
+void imhkernel_minhash_hashed(List *list, ullong *seeds,
+                              uint number_of_hashes, ullong *minhashes)
+{
+     switch (imhkernel_level()) {
+     case IMHKERNEL_AVX512:
+          imhkernel_minhash_hashed_avx512(list, seeds, number_of_hashes, minhashes);
+          break;
+     case IMHKERNEL_AVX2:
+          imhkernel_minhash_hashed_avx2(list, seeds, number_of_hashes, minhashes);
+          break;
+     default:
+          imhkernel_minhash_hashed_scalar(list, seeds, number_of_hashes, minhashes);
+     }
+}
+
+/**
+ * @brief Computes several MinHash values of a list from an item-major
+ *        store of 32-bit ranks in one sweep over its items with the best
+ *        kernel supported by the processor.
+ *
+ * @param list List to be hashed
+ * @param ranks Rank store (one row of ranks per item)
+ * @param stride Number of ranks per row
+ * @param first First column of the rows to be used
+ * @param number_of_hashes Number of MinHash functions (columns)
+ * @param minhashes Computed MinHash values
+ */
+void imhkernel_minhash_ranks(List *list, uint *ranks, uint stride, uint first,
+                             uint number_of_hashes, ullong *minhashes)
+{
+     switch (imhkernel_level()) {
+     case IMHKERNEL_AVX512:
+          imhkernel_minhash_ranks_avx512(list, ranks, stride, first, number_of_hashes, minhashes);
+          break;
+     case IMHKERNEL_AVX2:
+          imhkernel_minhash_ranks_avx2(list, ranks, stride, first, number_of_hashes, minhashes);
+          break;
+     default:
+          imhkernel_minhash_ranks_scalar(list, ranks, stride, first, number_of_hashes, minhashes);
+     }
+}
+
+/**
+ * @brief Fills an array with consecutive outputs of a SplitMix64 stream
+ *        with the best kernel supported by the processor.
+ *
+ * @param key Key of the stream
+ * @param position Position of the first value
+ * @param number_of_values Number of values
+ * @param values Generated values
+ */
+void imhkernel_fill_splitmix(ullong key, ullong position, uint number_of_values,
+                             ullong *values)
+{
+     switch (imhkernel_level()) {
+     case IMHKERNEL_AVX512:
+          imhkernel_fill_splitmix_avx512(key, position, number_of_values, values);
+          break;
+     case IMHKERNEL_AVX2:
+          imhkernel_fill_splitmix_avx2(key, position, number_of_values, values);
+          break;
+     default:
+          imhkernel_fill_splitmix_scalar(key, position, number_of_values, values);
+     }
+}
+
+/**
+ * @brief Computes the size of the intersection of two sets of items given
+ *        as increasing arrays, choosing the kernel from their sizes: an
+ *        exponential search when one set is much larger than the other and
+ *        the best block-compare merge supported by the processor otherwise.
+ *
+ * @param a First array of items
+ * @param size_a Number of items in the first array
+ * @param b Second array of items
+ * @param size_b Number of items in the second array
+ *
+ * @return Size of the intersection
+ */
+uint imhkernel_intersection_size(const uint *a, uint size_a, const uint *b, uint size_b)
+{
+     if (size_a > size_b)
+          return imhkernel_intersection_size(b, size_b, a, size_a);
+     if (size_a == 0)
+          return 0;
+     if (size_b / size_a >= IMHKERNEL_GALLOP_RATIO)
+          return imhkernel_intersect_gallop(a, size_a, b, size_b);
+
+     // blocks of 16 items need twice as many rotations, so AVX-512 is not faster
+     if (imhkernel_level() >= IMHKERNEL_AVX2)
+          return imhkernel_intersect_avx2(a, size_a, b, size_b);
+     else
+          return imhkernel_intersect_scalar(a, size_a, b, size_b);
+}
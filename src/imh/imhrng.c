@@ -0,0 +1,171 @@
+/**
+ * @file imhrng.c
+ * @author Gibran Fuentes-Pineda <gibranfp@unam.mx>
+ * @date 2017
+ *
+ * @section GPL
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * @brief Counter-based random number generator (SplitMix64)
+ *
+ *        The value at position p of the stream with key k is the SplitMix64
+ *        output function applied to k + (p + 1) * gamma, and the key of a
+ *        stream is derived in the same way from a seed and a stream number,
+ *        so any value of any stream can be computed without generating
+ *        the ones before it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "imhkernel.h"
+#include "imhrng.h"
+
+/**
+ * @brief Global stream used by the functions that do not take one
+ *        (key 0 until it is seeded)
+ */
+static RandomStream global_stream = {0, 0};
+
+/**
+ * @brief Output function of SplitMix64
+ *
+ * @param z Value to be mixed
+ *
+ * @return Mixed value
+ */
+static inline ullong imhrng_mix(ullong z)
+{
+     z = (z ^ (z >> 30)) * IMHKERNEL_MIX1;
+     z = (z ^ (z >> 27)) * IMHKERNEL_MIX2;
+
+     return z ^ (z >> 31);
+}
+
+/**
+ * @brief Computes the key of a stream
+ *
+ * @param seed Seed
+ * @param stream Stream number (e.g. number of a table)
+ *
+ * @return Key of the stream
+ */
+ullong imhrng_key(ullong seed, ullong stream)
+{
+     return imhrng_mix(imhrng_mix(seed) + (stream + 1) * IMHKERNEL_GAMMA);
+}
+
+/**
+ * @brief Computes the value at a given position of a stream directly
+ *
+ * @param seed Seed
+ * @param stream Stream number
+ * @param position Position in the stream
+ *
+ * @return Random 64-bit value
+ */
+ullong imhrng_at(ullong seed, ullong stream, ullong position)
+{
+     return imhrng_mix(imhrng_key(seed, stream) + (position + 1) * IMHKERNEL_GAMMA);
+}
+
+/**
+ * @brief Initializes a stream at its first position
+ *
+ * @param random_stream Stream
+ * @param seed Seed
+ * @param stream Stream number
+ */
+void imhrng_init(RandomStream *random_stream, ullong seed, ullong stream)
+{
+     random_stream->key = imhrng_key(seed, stream);
+     random_stream->position = 0;
+}
+
+/**
+ * @brief Moves a stream to a given position
+ *
+ * @param random_stream Stream
+ * @param position New position
+ */
+void imhrng_seek(RandomStream *random_stream, ullong position)
+{
+     random_stream->position = position;
+}
+
+/**
+ * @brief Generates the next random value of a stream
+ *
+ * @param random_stream Stream
+ *
+ * @return Random value on [0, 2^64-1]
+ */
+ullong imhrng_next(RandomStream *random_stream)
+{
+     return imhrng_mix(random_stream->key + ++random_stream->position * IMHKERNEL_GAMMA);
+}
+
+/**
+ * @brief Generates the next random value of a stream on [0,1]
+ *
+ * @param random_stream Stream
+ *
+ * @return Random value on [0,1]
+ */
+double imhrng_next_double(RandomStream *random_stream)
+{
+     return (imhrng_next(random_stream) >> 11) * (1.0 / MAX_SAFE_INT);
+}
+
+/**
+ * @brief Generates the next values of a stream at once with the best
+ *        kernel supported by the processor
+ *
+ * @param random_stream Stream
+ * @param values Generated values
+ * @param number_of_values Number of values
+ */
+void imhrng_fill(RandomStream *random_stream, ullong *values, uint number_of_values)
+{
+     imhkernel_fill_splitmix(random_stream->key, random_stream->position,
+                             number_of_values, values);
+     random_stream->position += number_of_values;
+}
+
+/**
+ * @brief Generates the next values of a stream on [0,1] at once
+ *
+ * @param random_stream Stream
+ * @param values Generated values
+ * @param number_of_values Number of values
+ */
+void imhrng_fill_double(RandomStream *random_stream, double *values, uint number_of_values)
+{
+     uint i;
+
+     // the 64-bit values are generated in place, since both types have the same size
+     imhrng_fill(random_stream, (ullong *) values, number_of_values);
+     for (i = 0; i < number_of_values; i++) {
+          ullong int_value;
+          memcpy(&int_value, &values[i], sizeof(ullong));
+          values[i] = (int_value >> 11) * (1.0 / MAX_SAFE_INT);
+     }
+}
+
+/**
+ * @brief Gets the global stream
+ *
+ * @return Global stream
+ */
+RandomStream *imhrng_global(void)
+{
+     return &global_stream;
+}
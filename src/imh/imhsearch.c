@@ -1,3 +1,6 @@
+
+
+
 /**
  * @file imhsearch.c
  * @author Gibran Fuentes-Pineda <gibranfp@unam.mx>
@@ -19,9 +22,16 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "array_lists.h"
 #include "listdb.h"
+#include "imhkernel.h"
 #include "imhsearch.h"
 
 /**
@@ -36,12 +46,14 @@ void imhsearch_print_index_head(HashIndex *hash_index)
             "Table size: %d\n"
             "Tuple size: %d\n"
             "Dimensionality: %d\n"
-            "Sublist size: %d\n",
+            "Sublist size: %d\n"
+            "Scheme: %s\n",
             hash_index->number_of_tables,
             hash_index->hash_tables[0].table_size, 
             hash_index->hash_tables[0].tuple_size,
             hash_index->hash_tables[0].dim,
-            hash_index->hash_tables[0].sublist_size); 
+            hash_index->hash_tables[0].sublist_size,
+            imh_scheme_name(hash_index->scheme)); 
 }
 
 /**
@@ -58,6 +70,108 @@ void imhsearch_print_index_tables(HashIndex *hash_index)
      }
 }
 
+/**
+ * @brief Initializes a hash index structure
+ *
+ * @param hash_index Hash index structure
+ */
+void imhsearch_init_index(HashIndex *hash_index)
+{
+     hash_index->number_of_tables = 0;
+     hash_index->tuple_size = 0;
+     hash_index->scheme = IMH_SCHEME_PERMUTATIONS;
+     hash_index->seeds = NULL;
+     hash_index->ranks = NULL;
+     hash_index->rank_stride = 0;
+     hash_index->number_of_lists = 0;
+     hash_index->hash_tables = NULL;
+     hash_index->signatures = NULL;
+     hash_index->mapping = NULL;
+     hash_index->mapping_size = 0;
+}
+
+/**
+ * @brief Work shared by the threads of a parallel build
+ */
+typedef struct BuildJob {
+     ListDB *listdb;
+     HashIndex *hash_index;
+     uint table_size;
+     uint dim;
+     uint sublist_size;
+     ullong master_seed;
+     ullong sublist_seed;
+} BuildJob;
+
+/**
+ * @brief Work of a single thread of a parallel build
+ */
+typedef struct BuildTask {
+     BuildJob *job;
+     uint first_table;
+     uint number_of_tables;
+} BuildTask;
+
+/**
+ * @brief Creates a table of a hash index with its own stream of random values,
+ *        given by the master seed of the build and the number of the table
+ *
+ * @param job Parallel build
+ * @param table Number of the table
+ */
+static void imhsearch_create_table(BuildJob *job, uint table)
+{
+     HashIndex *hash_index = job->hash_index;
+     uint tuple_size = hash_index->tuple_size;
+     HashTable *hash_table = &hash_index->hash_tables[table];
+     RandomStream rng;
+
+     imhrng_init(&rng, job->master_seed, table);
+     if (hash_index->scheme == IMH_SCHEME_HASHED) {
+          *hash_table = imh_create_table_hashed_r(job->table_size, tuple_size, job->dim,
+                                                  job->sublist_size, &rng);
+          memcpy(&hash_index->seeds[table * tuple_size], hash_table->seeds,
+                 tuple_size * sizeof(ullong));
+     } else if (hash_index->scheme == IMH_SCHEME_OPH) {
+          *hash_table = imh_create_table_oph_r(job->table_size, tuple_size, job->dim,
+                                               job->sublist_size, hash_index->seeds[0],
+                                               hash_index->number_of_tables * tuple_size,
+                                               table * tuple_size, &rng);
+     } else if (hash_index->scheme == IMH_SCHEME_RANKS) {
+          imh_generate_ranks_r(job->dim, table * tuple_size, tuple_size,
+                               hash_index->rank_stride, hash_index->ranks, &rng);
+          *hash_table = imh_create_table_ranks_r(job->table_size, tuple_size, job->dim,
+                                                 job->sublist_size, hash_index->ranks,
+                                                 hash_index->rank_stride,
+                                                 table * tuple_size, &rng);
+     } else {
+          *hash_table = imh_create_table_r(job->table_size, tuple_size, job->dim,
+                                           job->sublist_size, &rng);
+          imh_generate_permutations_r(job->dim, tuple_size, hash_table->permutations, &rng);
+     }
+}
+
+/**
+ * @brief Thread routine of imhsearch_build_parallel. Creates a contiguous
+ *        range of tables and builds them with a counting and a filling pass.
+ *
+ * @param arg Build task of the thread
+ */
+static void *imhsearch_build_worker(void *arg)
+{
+     BuildTask *task = (BuildTask *) arg;
+     uint i;
+
+     for (i = task->first_table; i < task->first_table + task->number_of_tables; i++)
+          imhsearch_create_table(task->job, i);
+
+     imhsearch_count_listdb_range(task->job->listdb, task->job->sublist_size,
+                                  task->job->sublist_seed, task->job->hash_index,
+                                  task->first_table, task->number_of_tables);
+
+     return NULL;
+}
+
 /**
  * @brief Creates a hash index and stores a database of lists in each hash table
  *
@@ -65,43 +179,802 @@ void imhsearch_print_index_tables(HashIndex *hash_index)
  * @param number_of_tables Number of tables
  * @param tuple_size Number of hash values per tuple
  * @param table_size Number of buckets in the hash table
+ * @param sublist_size Size of sublists
+ * @param scheme How the random values of the MinHash functions are generated
+ *               (IMH_SCHEME_PERMUTATIONS, IMH_SCHEME_HASHED, IMH_SCHEME_OPH
+ *               or IMH_SCHEME_RANKS)
  *
  * @returns Hash index
  */
 HashIndex imhsearch_build(ListDB *listdb, uint number_of_tables, uint tuple_size,
-                          uint table_size, uint sublist_size)
-{
-     // Generates sublists
-     uint *sublist_number = (uint *) malloc(listdb->size * sizeof(uint));
-     uint sublistdb_size = imh_get_sublist_numbers(listdb,
-                                                   sublist_size,
-                                                   sublist_number);
-     uint *sublistdb_ids = (uint *) malloc(sublistdb_size * sizeof(uint));
-     ListDB sublistdb = imh_create_sublistdb_from_listdb(listdb,
-                                                         sublist_number,
-                                                         sublistdb_size,
-                                                         sublist_size,
-                                                         sublistdb_ids);
+                          uint table_size, uint sublist_size, uint scheme)
+{
+     return imhsearch_build_parallel(listdb, number_of_tables, tuple_size, table_size,
+                                     sublist_size, scheme, 1);
+}
+
+/**
+ * @brief Creates a hash index and stores a database of lists in each hash
+ *        table using several threads. Each thread creates a contiguous range
+ *        of tables and builds all of them at once, straight into the frozen
+ *        layout, with two passes over the lists (see imhsearch_count_listdb_range).
+ *        The random values of every table come from its own stream, given
+ *        by a master seed drawn from the global stream and the number of
+ *        the table, so the index is the same for any number of threads.
+ *        The bit signatures of the lists are not built
+ *        (see imhsearch_build_signatures).
+ *
+ * @param listdb Database of lists to be hashed
+ * @param number_of_tables Number of tables
+ * @param tuple_size Number of hash values per tuple
+ * @param table_size Number of buckets in the hash table
+ * @param sublist_size Size of sublists
+ * @param scheme How the random values of the MinHash functions are generated
+ *               (IMH_SCHEME_PERMUTATIONS, IMH_SCHEME_HASHED, IMH_SCHEME_OPH
+ *               or IMH_SCHEME_RANKS)
+ * @param number_of_threads Number of threads (0 uses all online processors)
+ *
+ * @returns Hash index
+ */
+HashIndex imhsearch_build_parallel(ListDB *listdb, uint number_of_tables, uint tuple_size,
+                                   uint table_size, uint sublist_size, uint scheme,
+                                   uint number_of_threads)
+{
+     // Seed of the streams used to split the lists into sublists
+     ullong sublist_seed = imhrng_next(imhrng_global());
 
      // Creates hash index
      HashIndex hash_index;
+     imhsearch_init_index(&hash_index);
      hash_index.number_of_tables = number_of_tables;
+     hash_index.number_of_lists = listdb->size;
+     hash_index.tuple_size = tuple_size;
+     hash_index.scheme = scheme;
+     hash_index.seeds = NULL;
+     hash_index.ranks = NULL;
+     hash_index.rank_stride = 0;
      hash_index.hash_tables = (HashTable *) malloc(number_of_tables * sizeof(HashTable));
+     if (scheme == IMH_SCHEME_HASHED) {
+          hash_index.seeds = (ullong *) malloc(number_of_tables * tuple_size * sizeof(ullong));
+     } else if (scheme == IMH_SCHEME_OPH) {
+          hash_index.seeds = (ullong *) malloc(sizeof(ullong));
+          hash_index.seeds[0] = imhrng_next(imhrng_global());
+     } else if (scheme == IMH_SCHEME_RANKS) {
+          hash_index.rank_stride = imh_get_rank_stride(number_of_tables * tuple_size);
+          hash_index.ranks = imh_create_ranks(listdb->dim, hash_index.rank_stride);
+          imh_pad_ranks(listdb->dim, number_of_tables * tuple_size,
+                        hash_index.rank_stride, hash_index.ranks);
+     }
+
+     // Creates hash tables and stores the sublists in them
+     if (number_of_threads == 0) {
+          long online = sysconf(_SC_NPROCESSORS_ONLN);
+          number_of_threads = online > 0 ? (uint) online : 1;
+     }
+     if (number_of_threads > number_of_tables)
+          number_of_threads = number_of_tables > 0 ? number_of_tables : 1;
+
+     BuildJob job = {listdb, &hash_index, table_size, listdb->dim, sublist_size,
+                     imhrng_next(imhrng_global()), sublist_seed};
+     BuildTask *tasks = (BuildTask *) malloc(number_of_threads * sizeof(BuildTask));
+     uint i;
+     for (i = 0; i < number_of_threads; i++) {
+          tasks[i].job = &job;
+          tasks[i].first_table = (uint) ((ullong) i * number_of_tables / number_of_threads);
+          tasks[i].number_of_tables = (uint) ((ullong) (i + 1) * number_of_tables
+                                              / number_of_threads) - tasks[i].first_table;
+     }
+
+     if (number_of_threads == 1) {
+          imhsearch_build_worker(&tasks[0]);
+     } else {
+          pthread_t *threads = (pthread_t *) malloc(number_of_threads * sizeof(pthread_t));
+          for (i = 0; i < number_of_threads; i++) {
+               if (pthread_create(&threads[i], NULL, imhsearch_build_worker, &tasks[i]) != 0) {
+                    fprintf(stderr,"Error: Could not create build thread %u\n", i);
+                    exit(EXIT_FAILURE);
+               }
+          }
+          for (i = 0; i < number_of_threads; i++)
+               pthread_join(threads[i], NULL);
+          free(threads);
+     }
+     free(tasks);
+
+     return hash_index;
+}
+
+/**
+ * @brief Bit of the signature of a list that is set by an item
+ */
+static inline uint imhsearch_signature_bit(uint item)
+{
+     return (uint) ((item * IMHKERNEL_GAMMA) >> 55); // 9 bits, IMHSEARCH_SIGNATURE_WORDS * 64
+}
+
+/**
+ * @brief Computes the bit signature of a list: each item sets one of its
+ *        IMHSEARCH_SIGNATURE_WORDS * 64 bits
+ *
+ * @param list List
+ * @param signature Signature of the list
+ */
+static void imhsearch_compute_signature(List *list, ullong *signature)
+{
+     uint i;
+
+     memset(signature, 0, IMHSEARCH_SIGNATURE_WORDS * sizeof(ullong));
+     for (i = 0; i < list->size; i++) {
+          uint bit = imhsearch_signature_bit(list->data[i].item);
+          signature[bit >> 6] |= 1ULL << (bit & 63);
+     }
+}
+
+/**
+ * @brief Bounds the size of the intersection of two lists with their bit
+ *        signatures. The items of a list that set a bit missing from the
+ *        signature of the other one are not in the intersection, and every
+ *        such bit was set by at least one of them.
+ *
+ * @param signature1 Signature of the first list
+ * @param size1 Size of the first list
+ * @param signature2 Signature of the second list
+ * @param size2 Size of the second list
+ *
+ * @return Largest possible size of the intersection
+ */
+static inline uint imhsearch_signature_bound(const ullong *signature1, uint size1,
+                                             const ullong *signature2, uint size2)
+{
+     uint i, only1 = 0, only2 = 0;
+
+     for (i = 0; i < IMHSEARCH_SIGNATURE_WORDS; i++) {
+          only1 += __builtin_popcountll(signature1[i] & ~signature2[i]);
+          only2 += __builtin_popcountll(signature2[i] & ~signature1[i]);
+     }
+     size1 -= only1;
+     size2 -= only2;
+
+     return size1 < size2 ? size1 : size2;
+}
+
+/**
+ * @brief Builds the bit signatures of the lists stored in a hash index.
+ *        They are optional and kept contiguously (IMHSEARCH_SIGNATURE_WORDS
+ *        words per list, a cache line), are saved with the index and give
+ *        an upper bound of the overlap of a query with a list without
+ *        reading its items, so top-k and threshold queries skip the
+ *        candidates that cannot make it.
+ *
+ * @param hash_index Hash index structure (not loaded from a file)
+ * @param listdb Database of lists stored in the hash index
+ */
+void imhsearch_build_signatures(HashIndex *hash_index, ListDB *listdb)
+{
+     uint i;
+
+     if (hash_index->mapping != NULL) {
+          fprintf(stderr,"Error: Signatures cannot be built for a loaded hash index\n");
+          exit(EXIT_FAILURE);
+     }
+     free(hash_index->signatures);
+     hash_index->signatures = (ullong *) malloc(((size_t) listdb->size + 1)
+                                                * IMHSEARCH_SIGNATURE_WORDS * sizeof(ullong));
+     for (i = 0; i < listdb->size; i++)
+          imhsearch_compute_signature(&listdb->lists[i],
+                                      &hash_index->signatures[(size_t) i * IMHSEARCH_SIGNATURE_WORDS]);
+}
+
+/**
+ * @brief Destroys a hash index structure
+ *
+ * @param hash_index Hash index structure
+ */
+void imhsearch_destroy(HashIndex *hash_index)
+{
+     uint i;
+
+     if (hash_index->mapping != NULL) { // the tables point into the mapped file
+          free(hash_index->hash_tables);
+          munmap(hash_index->mapping, hash_index->mapping_size);
+          imhsearch_init_index(hash_index);
+          return;
+     }
+
+     for (i = 0; i < hash_index->number_of_tables; i++)
+          imh_destroy_table(&hash_index->hash_tables[i]);
+
+     free(hash_index->hash_tables);
+     free(hash_index->seeds);
+     free(hash_index->ranks);
+     free(hash_index->signatures);
+     imhsearch_init_index(hash_index);
+}
+
+/**
+ * @brief Freezes all the tables of a hash index into the compressed
+ *        layout (see imh_freeze_table). Queries are answered the same way
+ *        but nothing else can be stored in the index afterwards. Indexes
+ *        given by imhsearch_build are already frozen, so this is only needed
+ *        after storing lists with imhsearch_store_listdb.
+ *
+ * @param hash_index Hash index structure
+ */
+void imhsearch_freeze(HashIndex *hash_index)
+{
+     uint i;
+
+     for (i = 0; i < hash_index->number_of_tables; i++)
+          imh_freeze_table(&hash_index->hash_tables[i]);
+}
+
+/**
+ * @brief Writes a section of a hash index file, padded with zeros up to
+ *        the next IMHSEARCH_FILE_ALIGNMENT bytes
+ *
+ * @param file Hash index file
+ * @param data Data of the section
+ * @param bytes Size of the section in bytes
+ */
+static void imhsearch_write_section(FILE *file, const void *data, size_t bytes)
+{
+     static const char zeros[IMHSEARCH_FILE_ALIGNMENT] = {0};
+     size_t padding = (IMHSEARCH_FILE_ALIGNMENT - bytes % IMHSEARCH_FILE_ALIGNMENT)
+          % IMHSEARCH_FILE_ALIGNMENT;
+
+     if (bytes > 0)
+          fwrite(data, 1, bytes, file);
+     fwrite(zeros, 1, padding, file);
+}
 
-     // Stores lists in each hash table 
+/**
+ * @brief Saves a hash index in a binary file (native byte order) that can be
+ *        used after mapping it in memory, without deserializing it (see
+ *        imhsearch_load_index). The file holds the parameters of the index,
+ *        the parameters of the MinHash functions (a and b of the universal
+ *        hash functions and the permutations, seeds or ranks of the scheme)
+ *        and the buckets of each table in the frozen layout. The index is
+ *        frozen first if needed.
+ *
+ * @param filename File where the hash index will be saved
+ * @param hash_index Hash index structure
+ */
+void imhsearch_save_index(char *filename, HashIndex *hash_index)
+{
      uint i;
-     for (i = 0; i < number_of_tables; i++) {
-          hash_index.hash_tables[i] = imh_create_table(table_size,
-                                                       tuple_size,
-                                                       listdb->dim,
-                                                       sublist_size);
-          imh_generate_permutations(listdb->dim, tuple_size, hash_index.hash_tables[i].permutations);
-          imh_store_sublistdb(&sublistdb, sublistdb_ids, &hash_index.hash_tables[i]);
+     FILE *file;
+
+     if (hash_index->number_of_tables == 0) {
+          fprintf(stderr,"Error: Empty hash indexes cannot be saved!\n");
+          exit(EXIT_FAILURE);
+     }
+     if (!(file = fopen(filename,"wb"))) {
+          fprintf(stderr,"Error: Could not create file %s\n", filename);
+          exit(EXIT_FAILURE);
      }
+     imhsearch_freeze(hash_index);
+
+     HashTable *first_table = &hash_index->hash_tables[0];
+     HashIndexHeader header;
+     memset(&header, 0, sizeof(header));
+     memcpy(header.magic, IMHSEARCH_MAGIC, sizeof(header.magic));
+     header.version = IMHSEARCH_VERSION;
+     header.number_of_tables = hash_index->number_of_tables;
+     header.tuple_size = hash_index->tuple_size;
+     header.scheme = hash_index->scheme;
+     header.table_size = first_table->table_size;
+     header.dim = first_table->dim;
+     header.sublist_size = first_table->sublist_size;
+     header.rank_stride = hash_index->rank_stride;
+     header.number_of_lists = hash_index->number_of_lists;
+     if (hash_index->scheme == IMH_SCHEME_HASHED)
+          header.number_of_seeds = hash_index->number_of_tables * hash_index->tuple_size;
+     else if (hash_index->scheme == IMH_SCHEME_OPH)
+          header.number_of_seeds = 1;
+     if (hash_index->signatures != NULL)
+          header.signature_words = IMHSEARCH_SIGNATURE_WORDS;
+     imhsearch_write_section(file, &header, sizeof(header));
+
+     ullong *number_of_ids = (ullong *) malloc(header.number_of_tables * sizeof(ullong));
+     for (i = 0; i < header.number_of_tables; i++)
+          number_of_ids[i] = hash_index->hash_tables[i].offsets[header.table_size];
+
+     if (hash_index->scheme == IMH_SCHEME_RANKS)
+          imhsearch_write_section(file, hash_index->ranks,
+                                  (size_t) header.dim * header.rank_stride * sizeof(uint));
+     imhsearch_write_section(file, hash_index->seeds, header.number_of_seeds * sizeof(ullong));
+     imhsearch_write_section(file, number_of_ids, header.number_of_tables * sizeof(ullong));
+
+     for (i = 0; i < header.number_of_tables; i++) {
+          HashTable *hash_table = &hash_index->hash_tables[i];
+          imhsearch_write_section(file, hash_table->a, header.tuple_size * sizeof(uint));
+          imhsearch_write_section(file, hash_table->b, header.tuple_size * sizeof(uint));
+          if (hash_index->scheme == IMH_SCHEME_PERMUTATIONS)
+               imhsearch_write_section(file, hash_table->permutations, (size_t) header.tuple_size
+                                       * header.dim * sizeof(RandomValue));
+          imhsearch_write_section(file, hash_table->keys, header.table_size * sizeof(uint));
+          imhsearch_write_section(file, hash_table->offsets,
+                                  (header.table_size + 1ULL) * sizeof(uint));
+          imhsearch_write_section(file, hash_table->ids, number_of_ids[i] * sizeof(uint));
+     }
+     free(number_of_ids);
+     if (hash_index->signatures != NULL)
+          imhsearch_write_section(file, hash_index->signatures, (size_t) header.number_of_lists
+                                  * IMHSEARCH_SIGNATURE_WORDS * sizeof(ullong));
+
+     if (ferror(file) || fclose(file)) {
+          fprintf(stderr,"Error: Could not write file %s\n", filename);
+          exit(EXIT_FAILURE);
+     }
+}
+
+/**
+ * @brief Gets the next section of a mapped hash index file
+ *
+ * @param cursor Position of the section, moved to the next one
+ * @param end End of the mapped file
+ * @param bytes Size of the section in bytes
+ * @param filename Name of the file in error messages
+ *
+ * @return Start of the section
+ */
+static void *imhsearch_map_section(char **cursor, char *end, ullong bytes, char *filename)
+{
+     char *section = *cursor;
+     ullong padded = (bytes + IMHSEARCH_FILE_ALIGNMENT - 1)
+          / IMHSEARCH_FILE_ALIGNMENT * IMHSEARCH_FILE_ALIGNMENT;
+
+     if (padded > (ullong) (end - section)) {
+          fprintf(stderr,"Error: %s is truncated\n", filename);
+          exit(EXIT_FAILURE);
+     }
+     *cursor += padded;
+
+     return section;
+}
+
+/**
+ * @brief Loads a hash index saved with imhsearch_save_index. The file is
+ *        mapped in memory and the tables point into it, so the index is
+ *        ready to answer queries without being deserialized, and processes
+ *        that load the same file share its pages. Nothing else can be
+ *        stored in a loaded index. The parameters, seeds and bucket
+ *        offsets of the file are checked, so a corrupted or foreign file is
+ *        rejected here instead of being read out of bounds by the queries.
+ *        The IDs themselves are not scanned, so loading only reads the
+ *        pages of the offsets and not the whole file.
+ *
+ * @param filename File with the hash index
+ *
+ * @return Hash index
+ */
+HashIndex imhsearch_load_index(char *filename)
+{
+     uint i, j;
+     int fd;
+     struct stat info;
+
+     if ((fd = open(filename, O_RDONLY)) < 0) {
+          fprintf(stderr,"Error: Could not open file %s\n", filename);
+          exit(EXIT_FAILURE);
+     }
+     if (fstat(fd, &info) != 0 || info.st_size < (off_t) sizeof(HashIndexHeader)) {
+          fprintf(stderr,"Error: %s is not a hash index file\n", filename);
+          exit(EXIT_FAILURE);
+     }
+
+     size_t size = (size_t) info.st_size;
+     char *mapping = (char *) mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+     close(fd);
+     if (mapping == MAP_FAILED) {
+          fprintf(stderr,"Error: Could not map file %s\n", filename);
+          exit(EXIT_FAILURE);
+     }
+
+     char *cursor = mapping;
+     char *end = mapping + size;
+     HashIndexHeader *header = (HashIndexHeader *) imhsearch_map_section(&cursor, end,
+                                                                         sizeof(HashIndexHeader),
+                                                                         filename);
+     if (memcmp(header->magic, IMHSEARCH_MAGIC, sizeof(header->magic)) != 0) {
+          fprintf(stderr,"Error: %s is not a hash index file\n", filename);
+          exit(EXIT_FAILURE);
+     }
+     if (header->version != IMHSEARCH_VERSION) {
+          fprintf(stderr,"Error: %s has version %u, expected version %u\n", filename,
+                  header->version, IMHSEARCH_VERSION);
+          exit(EXIT_FAILURE);
+     }
+     if (header->number_of_tables == 0 || header->table_size == 0
+         || (header->table_size & (header->table_size - 1)) != 0 || header->tuple_size == 0) {
+          fprintf(stderr,"Error: %s has invalid parameters\n", filename);
+          exit(EXIT_FAILURE);
+     }
+     ullong number_of_hashes = (ullong) header->number_of_tables * header->tuple_size;
+     ullong number_of_seeds = header->scheme == IMH_SCHEME_HASHED ? number_of_hashes
+          : header->scheme == IMH_SCHEME_OPH ? 1 : 0;
+     if (header->scheme > IMH_SCHEME_RANKS) {
+          fprintf(stderr,"Error: %s has unknown scheme %u\n", filename, header->scheme);
+          exit(EXIT_FAILURE);
+     }
+     if (header->number_of_seeds != number_of_seeds) {
+          fprintf(stderr,"Error: %s has %u seeds, expected %llu\n", filename,
+                  header->number_of_seeds, number_of_seeds);
+          exit(EXIT_FAILURE);
+     }
+     if (header->scheme == IMH_SCHEME_RANKS && header->rank_stride < number_of_hashes) {
+          fprintf(stderr,"Error: %s has rank rows of %u columns for %llu MinHash functions\n",
+                  filename, header->rank_stride, number_of_hashes);
+          exit(EXIT_FAILURE);
+     }
+     if (header->signature_words != 0 && header->signature_words != IMHSEARCH_SIGNATURE_WORDS) {
+          fprintf(stderr,"Error: %s has signatures of %llu words, expected %u\n", filename,
+                  header->signature_words, IMHSEARCH_SIGNATURE_WORDS);
+          exit(EXIT_FAILURE);
+     }
+
+     HashIndex hash_index;
+     imhsearch_init_index(&hash_index);
+     hash_index.number_of_tables = header->number_of_tables;
+     hash_index.tuple_size = header->tuple_size;
+     hash_index.scheme = header->scheme;
+     hash_index.rank_stride = header->rank_stride;
+     hash_index.number_of_lists = header->number_of_lists;
+     hash_index.mapping = mapping;
+     hash_index.mapping_size = size;
+     if (header->scheme == IMH_SCHEME_RANKS)
+          hash_index.ranks = (uint *) imhsearch_map_section(&cursor, end, (ullong) header->dim
+                                                            * header->rank_stride * sizeof(uint),
+                                                            filename);
+     if (header->number_of_seeds > 0)
+          hash_index.seeds = (ullong *) imhsearch_map_section(&cursor, end, header->number_of_seeds
+                                                              * sizeof(ullong), filename);
+     ullong *number_of_ids = (ullong *) imhsearch_map_section(&cursor, end, header->number_of_tables
+                                                              * sizeof(ullong), filename);
+
+     hash_index.hash_tables = (HashTable *) malloc(header->number_of_tables * sizeof(HashTable));
+     for (i = 0; i < header->number_of_tables; i++) {
+          HashTable *hash_table = &hash_index.hash_tables[i];
+          imh_init_table(hash_table);
+          hash_table->table_size = header->table_size;
+          hash_table->tuple_size = header->tuple_size;
+          hash_table->dim = header->dim;
+          hash_table->sublist_size = header->sublist_size;
+          hash_table->scheme = header->scheme;
+          hash_table->a = (uint *) imhsearch_map_section(&cursor, end, header->tuple_size
+                                                         * sizeof(uint), filename);
+          hash_table->b = (uint *) imhsearch_map_section(&cursor, end, header->tuple_size
+                                                         * sizeof(uint), filename);
+          if (header->scheme == IMH_SCHEME_PERMUTATIONS) {
+               hash_table->permutations = (RandomValue *)
+                    imhsearch_map_section(&cursor, end, (ullong) header->tuple_size * header->dim
+                                          * sizeof(RandomValue), filename);
+          } else if (header->scheme == IMH_SCHEME_HASHED) {
+               hash_table->seeds = hash_index.seeds + i * header->tuple_size;
+          } else if (header->scheme == IMH_SCHEME_OPH) {
+               hash_table->seeds = hash_index.seeds;
+               hash_table->number_of_bins = header->number_of_tables * header->tuple_size;
+               hash_table->first_bin = i * header->tuple_size;
+          } else if (header->scheme == IMH_SCHEME_RANKS) {
+               hash_table->ranks = hash_index.ranks;
+               hash_table->rank_stride = header->rank_stride;
+               hash_table->first_bin = i * header->tuple_size;
+          }
+          hash_table->keys = (uint *) imhsearch_map_section(&cursor, end, header->table_size
+                                                            * sizeof(uint), filename);
+          hash_table->offsets = (uint *) imhsearch_map_section(&cursor, end, (header->table_size + 1ULL)
+                                                               * sizeof(uint), filename);
+          hash_table->ids = (uint *) imhsearch_map_section(&cursor, end, number_of_ids[i]
+                                                           * sizeof(uint), filename);
+          for (j = 0; j < header->table_size; j++)
+               if (hash_table->offsets[j] > hash_table->offsets[j + 1])
+                    break;
+          if (hash_table->offsets[0] != 0 || j < header->table_size
+              || hash_table->offsets[header->table_size] != number_of_ids[i]) {
+               fprintf(stderr,"Error: %s has corrupted offsets in table %u\n", filename, i);
+               exit(EXIT_FAILURE);
+          }
+     }
+     if (header->signature_words != 0)
+          hash_index.signatures = (ullong *) imhsearch_map_section(&cursor, end, (ullong)
+                                                                   header->number_of_lists
+                                                                   * header->signature_words
+                                                                   * sizeof(ullong), filename);
 
      return hash_index;
 }
 
+/**
+ * @brief Computes the MinHash tuples of a list for all the tables of a
+ *        hash index. Except with dense permutations, all of them are
+ *        computed in a single sweep over the items of the list.
+ *
+ * @param list List to be hashed
+ * @param hash_index Hash index structure
+ * @param minhashes MinHash values (number_of_tables * tuple_size), 
+ *                  tuple of each table stored consecutively
+ */
+void imhsearch_compute_minhashes(List *list, HashIndex *hash_index, ullong *minhashes)
+{
+     imhsearch_compute_minhashes_range(list, hash_index, 0, hash_index->number_of_tables,
+                                       minhashes);
+}
+
+/**
+ * @brief Computes the MinHash tuples of a list for a range of tables of a
+ *        hash index in a single sweep over the items of the list (except
+ *        with dense permutations). With one permutation hashing only the
+ *        bins of the range are computed (see imh_compute_oph_range).
+ *
+ * @param list List to be hashed
+ * @param hash_index Hash index structure
+ * @param first_table First table of the range
+ * @param number_of_tables Number of tables in the range
+ * @param minhashes MinHash values (hash_index->number_of_tables * tuple_size),
+ *                  tuple of each table stored consecutively; only the tuples
+ *                  of the range are set
+ */
+void imhsearch_compute_minhashes_range(List *list, HashIndex *hash_index, uint first_table,
+                                       uint number_of_tables, ullong *minhashes)
+{
+     uint i;
+     uint first = first_table * hash_index->tuple_size;
+     uint number_of_hashes = number_of_tables * hash_index->tuple_size;
+
+     if (hash_index->scheme == IMH_SCHEME_HASHED) {
+          imhkernel_minhash_hashed(list, &hash_index->seeds[first], number_of_hashes,
+                                   &minhashes[first]);
+     } else if (hash_index->scheme == IMH_SCHEME_RANKS) {
+          imhkernel_minhash_ranks(list, hash_index->ranks, hash_index->rank_stride, first,
+                                  number_of_hashes, &minhashes[first]);
+     } else if (hash_index->scheme == IMH_SCHEME_OPH) {
+          imh_compute_oph_range(list, hash_index->seeds[0],
+                                hash_index->number_of_tables * hash_index->tuple_size,
+                                first, number_of_hashes, &minhashes[first]);
+     } else {
+          for (i = first_table; i < first_table + number_of_tables; i++)
+               imh_compute_tuple(list, &hash_index->hash_tables[i],
+                                 &minhashes[i * hash_index->tuple_size]);
+     }
+}
+
+/**
+ * @brief Stores a database of lists in all the tables of a hash index.
+ *        The sublists of each list are generated on the fly (the ones of
+ *        list i are given by imh_split_list with stream i of the seed) and
+ *        hashed while their items are in cache, so the database of
+ *        sublists is never materialized and the lists are streamed through
+ *        memory only once.
+ *
+ * @param listdb Database of lists to be hashed
+ * @param sublist_size Size of the sublists
+ * @param seed Seed of the streams used to split the lists
+ * @param hash_index Hash index structure
+ */
+void imhsearch_store_listdb(ListDB *listdb, uint sublist_size, ullong seed,
+                            HashIndex *hash_index)
+{
+     imhsearch_store_listdb_range(listdb, sublist_size, seed, hash_index, 0,
+                                  hash_index->number_of_tables);
+}
+
+/**
+ * @brief Stores a database of lists in a range of tables of a hash index
+ *        in a single pass (see imhsearch_store_listdb). Threads storing
+ *        disjoint ranges do not share any table and generate the same
+ *        sublists.
+ *
+ * @param listdb Database of lists to be hashed
+ * @param sublist_size Size of the sublists
+ * @param seed Seed of the streams used to split the lists
+ * @param hash_index Hash index structure
+ * @param first_table First table of the range
+ * @param number_of_tables Number of tables in the range
+ */
+void imhsearch_store_listdb_range(ListDB *listdb, uint sublist_size, ullong seed,
+                                  HashIndex *hash_index, uint first_table,
+                                  uint number_of_tables)
+{
+     imhsearch_pass_listdb_range(listdb, sublist_size, seed, hash_index, first_table,
+                                 number_of_tables, IMHSEARCH_PASS_STORE);
+}
+
+/**
+ * @brief Builds a range of empty tables of a hash index straight into the
+ *        compressed layout with two passes over a database of lists, one
+ *        counting the IDs of each bucket and one writing them in place
+ *        (see imh_start_counting). The tables end up as if the lists had
+ *        been stored and the tables frozen, without any allocation per ID.
+ *
+ * @param listdb Database of lists to be hashed
+ * @param sublist_size Size of the sublists
+ * @param seed Seed of the streams used to split the lists
+ * @param hash_index Hash index structure
+ * @param first_table First table of the range
+ * @param number_of_tables Number of tables in the range
+ */
+void imhsearch_count_listdb_range(ListDB *listdb, uint sublist_size, ullong seed,
+                                  HashIndex *hash_index, uint first_table,
+                                  uint number_of_tables)
+{
+     uint i;
+
+     for (i = first_table; i < first_table + number_of_tables; i++)
+          imh_start_counting(&hash_index->hash_tables[i]);
+     imhsearch_pass_listdb_range(listdb, sublist_size, seed, hash_index, first_table,
+                                 number_of_tables, IMHSEARCH_PASS_COUNT);
+
+     for (i = first_table; i < first_table + number_of_tables; i++)
+          imh_start_filling(&hash_index->hash_tables[i]);
+     imhsearch_pass_listdb_range(listdb, sublist_size, seed, hash_index, first_table,
+                                 number_of_tables, IMHSEARCH_PASS_FILL);
+
+     for (i = first_table; i < first_table + number_of_tables; i++)
+          imh_finish_filling(&hash_index->hash_tables[i]);
+}
+
+/**
+ * @brief Makes one pass over a database of lists for a range of tables of a
+ *        hash index. The sublists of each list are generated on the fly
+ *        and their tuples are stored, counted or filled in every table of
+ *        the range.
+ *
+ * @param listdb Database of lists to be hashed
+ * @param sublist_size Size of the sublists
+ * @param seed Seed of the streams used to split the lists
+ * @param hash_index Hash index structure
+ * @param first_table First table of the range
+ * @param number_of_tables Number of tables in the range
+ * @param pass IMHSEARCH_PASS_STORE, IMHSEARCH_PASS_COUNT or IMHSEARCH_PASS_FILL
+ */
+void imhsearch_pass_listdb_range(ListDB *listdb, uint sublist_size, ullong seed,
+                                 HashIndex *hash_index, uint first_table,
+                                 uint number_of_tables, uint pass)
+{
+     uint i, j, k;
+     uint largest_size = 0;
+     RandomStream rng;
+
+     for (i = 0; i < listdb->size; i++)
+          if (listdb->lists[i].size > largest_size)
+               largest_size = listdb->lists[i].size;
+
+     // scratch space for the sublists of a single list
+     Item *items = (Item *) malloc(largest_size * sizeof(Item));
+     List *sublists = (List *) malloc((largest_size / sublist_size + 1) * sizeof(List));
+     ullong *minhashes = (ullong *) malloc(hash_index->number_of_tables
+                                           * hash_index->tuple_size * sizeof(ullong));
+
+     for (i = 0; i < listdb->size; i++) {
+          imhrng_init(&rng, seed, i);
+          uint number_of_sublists = imh_split_list(&listdb->lists[i], sublist_size, &rng,
+                                                   items, sublists);
+          for (j = 0; j < number_of_sublists; j++) {
+               imhsearch_compute_minhashes_range(&sublists[j], hash_index, first_table,
+                                                 number_of_tables, minhashes);
+               for (k = first_table; k < first_table + number_of_tables; k++) {
+                    ullong *tuple = &minhashes[k * hash_index->tuple_size];
+                    if (pass == IMHSEARCH_PASS_COUNT)
+                         imh_count_tuple(tuple, &hash_index->hash_tables[k]);
+                    else if (pass == IMHSEARCH_PASS_FILL)
+                         imh_fill_tuple(tuple, i, &hash_index->hash_tables[k]);
+                    else
+                         imh_store_tuple(tuple, i, &hash_index->hash_tables[k]);
+               }
+          }
+     }
+
+     free(minhashes);
+     free(sublists);
+     free(items);
+}
+
+/**
+ * @brief Computes the overlap coefficient or the Jaccard similarity of two
+ *        lists from their sizes and the size of their intersection, in the
+ *        same way as list_overlap and list_jaccard
+ */
+static inline double imhsearch_similarity(uint intersection_size, uint size1, uint size2,
+                                          double (*func)(List *, List *))
+{
+     uint min_size = min(size1, size2);
+     if (min_size == 0)
+          return 0.0;
+     else if (func == list_overlap)
+          return (double) intersection_size / min_size;
+     else
+          return (double) intersection_size / (double) (size1 + size2 - intersection_size);
+}
+
+/**
+ * @brief Query prepared to be compared with many lists of the database
+ */
+typedef struct RerankQuery {
+     List *list;
+     uint *items; // column of items of the query
+     ullong *bitmap; // bit of each item of the query (NULL if it was not built)
+     uint max_item; // largest item of the query
+     ullong signature[IMHSEARCH_SIGNATURE_WORDS]; // bit signature of the query
+} RerankQuery;
+
+/**
+ * @brief Prepares a query to be compared with several lists: its items are
+ *        copied to a column and, if it is small compared with the work it
+ *        saves, a bitmap of its items is built
+ *
+ * @param rerank Prepared query
+ * @param query Query list (sorted by item)
+ * @param number_of_candidates Number of lists that will be compared with it
+ */
+static void imhsearch_rerank_init(RerankQuery *rerank, List *query, uint number_of_candidates)
+{
+     uint i;
+
+     rerank->list = query;
+     rerank->items = (uint *) malloc((query->size + 1) * sizeof(uint));
+     for (i = 0; i < query->size; i++)
+          rerank->items[i] = query->data[i].item;
+     rerank->bitmap = NULL;
+     rerank->max_item = 0;
+     imhsearch_compute_signature(query, rerank->signature);
+
+     if (query->size > 0) {
+          rerank->max_item = query->data[query->size - 1].item;
+          ullong words = rerank->max_item / 64 + 1;
+          if (words <= IMHSEARCH_BITMAP_WORDS
+              && words <= (ullong) number_of_candidates * IMHSEARCH_BITMAP_WORDS_PER_CANDIDATE) {
+               rerank->bitmap = (ullong *) calloc(words, sizeof(ullong));
+               for (i = 0; i < query->size; i++)
+                    rerank->bitmap[rerank->items[i] >> 6] |= 1ULL << (rerank->items[i] & 63);
+          }
+     }
+}
+
+/**
+ * @brief Frees a prepared query
+ *
+ * @param rerank Prepared query
+ */
+static void imhsearch_rerank_destroy(RerankQuery *rerank)
+{
+     free(rerank->items);
+     free(rerank->bitmap);
+}
+
+/**
+ * @brief Computes the score of a list of the database for a query. When the
+ *        database has split columns, overlap and Jaccard similarity count
+ *        the common items with the kernel that suits the sizes of the two
+ *        lists: probes of the bitmap of the query, an exponential search when
+ *        the list is much longer than the query or a block-compare merge.
+ *
+ * @param rerank Prepared query (imhsearch_rerank_init)
+ * @param listdb Database of lists stored in the hash tables
+ * @param id ID of the list
+ * @param func Score function (e.g. list_overlap)
+ *
+ * @return Score of the list
+ */
+static inline double imhsearch_score(RerankQuery *rerank, ListDB *listdb, uint id,
+                                     double (*func)(List *, List *))
+{
+     const uint *items = listdb_item_column(listdb, id);
+     if (items != NULL && (func == list_overlap || func == list_jaccard)) {
+          uint size = listdb->lists[id].size;
+          uint query_size = rerank->list->size;
+          uint intersection_size;
+          if (rerank->bitmap != NULL && size / IMHKERNEL_GALLOP_RATIO < query_size)
+               intersection_size = imhkernel_intersect_bitmap(rerank->bitmap, rerank->max_item,
+                                                              items, size);
+          else
+               intersection_size = imhkernel_intersection_size(rerank->items, query_size,
+                                                               items, size);
+          return imhsearch_similarity(intersection_size, query_size, size, func);
+     }
+
+     return func(rerank->list, &listdb->lists[id]);
+}
+
 /**
  * @brief Sorts neighbors found by Intersection Min-Hashing (imhsearch_query) using a score.
  *
@@ -109,23 +982,47 @@ HashIndex imhsearch_build(ListDB *listdb, uint number_of_tables, uint tuple_size
  * @param neighbors List of IDs of the neighbors found by Intersectio Min-Hashing (imhsearch_query)
  * @param listdb Database of lists stored in the hash tables
  * @param func Function to compute score of each neighbor found (e.g. Jaccard similarity)
- *             Given as a function pointer
+ *             Given as a function pointer. Overlap and Jaccard similarity only read
+ *             the column of items when the database has split columns.
  */
 void imhsearch_sort_custom(List *query, List *neighbors, ListDB *listdb, double (*func)(List *, List *))
+{
+     imhsearch_sort_scored(query, neighbors, listdb, func, NULL);
+}
+
+/**
+ * @brief Sorts neighbors found by Intersection Min-Hashing (imhsearch_query)
+ *        using a score and keeps the score of each neighbor.
+ *
+ * @param query Query list
+ * @param neighbors List of IDs of the neighbors found by Intersectio Min-Hashing (imhsearch_query)
+ * @param listdb Database of lists stored in the hash tables
+ * @param func Function to compute score of each neighbor found (e.g. Jaccard similarity)
+ * @param sorted_scores Where the score of each sorted neighbor is written
+ *                      (neighbors->size values) or NULL
+ */
+void imhsearch_sort_scored(List *query, List *neighbors, ListDB *listdb,
+                           double (*func)(List *, List *), double *sorted_scores)
 {
      Score *scores = malloc(neighbors->size * sizeof(Score));
+     RerankQuery rerank;
+     imhsearch_rerank_init(&rerank, query, neighbors->size);
 
      uint i;
      for (i = 0; i < neighbors->size; i++) {
           scores[i].index = i;
-          scores[i].value = func(query, &listdb->lists[neighbors->data[i].item]);
+          scores[i].value = imhsearch_score(&rerank, listdb, neighbors->data[i].item, func);
      }
+     imhsearch_rerank_destroy(&rerank);
 
      qsort(scores, neighbors->size, sizeof(Score), list_score_compare_back);
 
      List sorted = list_create(neighbors->size);
      for (i = 0; i < neighbors->size; i++) 
           sorted.data[i] = neighbors->data[scores[i].index];
+     if (sorted_scores != NULL)
+          for (i = 0; i < neighbors->size; i++) 
+               sorted_scores[i] = scores[i].value;
 
      list_destroy(neighbors);
      free(scores);
@@ -134,30 +1031,449 @@ void imhsearch_sort_custom(List *query, List *neighbors, ListDB *listdb, double
 }
 
 /**
- * @brief Queries the hash tables of an hash index structure with a given list
+ * @brief Position in a bucket while the buckets hit by a query are merged
+ */
+typedef struct BucketCursor {
+     uint id; // ID at the current position
+     uint position;
+     uint end;
+     const uint *ids; // IDs of a frozen table (NULL if the table is not frozen)
+     const Item *items; // items of the bucket of a table that is not frozen
+} BucketCursor;
+
+/**
+ * @brief Reads the ID at the current position of a bucket cursor
+ */
+static inline uint imhsearch_cursor_id(const BucketCursor *cursor)
+{
+     return cursor->ids != NULL ? cursor->ids[cursor->position] : cursor->items[cursor->position].item;
+}
+
+/**
+ * @brief Reads the frequency at the current position of a bucket cursor
+ */
+static inline uint imhsearch_cursor_freq(const BucketCursor *cursor)
+{
+     return cursor->ids != NULL ? 1 : cursor->items[cursor->position].freq;
+}
+
+/**
+ * @brief Moves a cursor down a binary min-heap of cursors ordered by ID
+ *
+ * @param heap Heap of cursors
+ * @param size Number of cursors in the heap
+ * @param i Position of the cursor to move
+ */
+static void imhsearch_sift_down(BucketCursor *heap, uint size, uint i)
+{
+     BucketCursor cursor = heap[i];
+
+     while (2 * i + 1 < size) {
+          uint child = 2 * i + 1;
+          if (child + 1 < size && heap[child + 1].id < heap[child].id)
+               child++;
+          if (heap[child].id >= cursor.id)
+               break;
+          heap[i] = heap[child];
+          i = child;
+     }
+     heap[i] = cursor;
+}
+
+/**
+ * @brief Merges buckets whose IDs are in increasing order (lists are stored
+ *        in the order of their IDs) into a list of unique IDs, where the
+ *        frequency of each ID is its number of collisions. Takes
+ *        O(n log L) time for n IDs in L buckets.
+ *
+ * @param heap Cursors at the beginning of each non-empty bucket
+ * @param size Number of cursors
+ * @param neighbors List where the IDs are written (with room for all of them)
+ *
+ * @return 1 if the buckets were merged or 0 if a bucket is out of order
+ */
+static int imhsearch_merge_buckets(BucketCursor *heap, uint size, List *neighbors)
+{
+     uint i;
+     for (i = size / 2; i-- > 0;)
+          imhsearch_sift_down(heap, size, i);
+
+     while (size > 0) {
+          BucketCursor *top = &heap[0];
+          uint id = top->id;
+          if (neighbors->size > 0 && neighbors->data[neighbors->size - 1].item == id) {
+               neighbors->data[neighbors->size - 1].freq += imhsearch_cursor_freq(top);
+          } else {
+               neighbors->data[neighbors->size].item = id;
+               neighbors->data[neighbors->size].freq = imhsearch_cursor_freq(top);
+               neighbors->size++;
+          }
+
+          if (++top->position < top->end) {
+               top->id = imhsearch_cursor_id(top);
+               if (top->id < id)
+                    return 0;
+          } else {
+               heap[0] = heap[--size];
+          }
+          if (size > 1)
+               imhsearch_sift_down(heap, size, 0);
+     }
+
+     return 1;
+}
+
+/**
+ * @brief Queries the hash tables of an hash index structure with a given list.
+ *        The buckets hit by the query are merged, so each neighbor appears
+ *        once with its number of collisions as frequency.
+ *        The index is only read, so several threads can query it at once.
  *
  * @param query Query list
  * @param hash_index Index structure with hash tables
  *
- * @return List of neighbors found
+ * @return List of neighbors found (sorted by ID)
  */
 List imhsearch_query(List *query, HashIndex *hash_index)
 {
      List neighbors;
      list_init(&neighbors);
 
-     uint i;
+     ullong *minhashes = (ullong *) malloc(hash_index->number_of_tables
+                                           * hash_index->tuple_size * sizeof(ullong));
+     uint *indices = (uint *) malloc(hash_index->number_of_tables * sizeof(uint));
+     BucketCursor *cursors = (BucketCursor *) malloc(hash_index->number_of_tables
+                                                     * sizeof(BucketCursor));
+     imhsearch_compute_minhashes(query, hash_index, minhashes);
+
+     uint i, number_of_cursors = 0, number_of_ids = 0;
      for (i = 0; i < hash_index->number_of_tables; i++) {
-          uint index = imh_get_index(query, &hash_index->hash_tables[i]);
-          list_append(&neighbors, &hash_index->hash_tables[i].buckets[index].items);
+          HashTable *hash_table = &hash_index->hash_tables[i];
+          indices[i] = imh_find_index_tuple(&minhashes[i * hash_index->tuple_size], hash_table);
+          if (indices[i] == IMH_NO_BUCKET)
+               continue;
+
+          BucketCursor cursor;
+          if (hash_table->offsets != NULL) {
+               cursor.ids = hash_table->ids;
+               cursor.items = NULL;
+               cursor.position = hash_table->offsets[indices[i]];
+               cursor.end = hash_table->offsets[indices[i] + 1];
+          } else {
+               cursor.ids = NULL;
+               cursor.items = hash_table->buckets[indices[i]].items.data;
+               cursor.position = 0;
+               cursor.end = hash_table->buckets[indices[i]].items.size;
+          }
+          if (cursor.position < cursor.end) {
+               cursor.id = imhsearch_cursor_id(&cursor);
+               cursors[number_of_cursors++] = cursor;
+               number_of_ids += cursor.end - cursor.position;
+          }
      }
 
-     list_sort_by_item(&neighbors);
-     list_unique(&neighbors);
+     if (number_of_ids > 0) {
+          list_reserve(&neighbors, number_of_ids);
+          if (!imhsearch_merge_buckets(cursors, number_of_cursors, &neighbors)) {
+               // lists were stored out of order, so their IDs are sorted instead
+               neighbors.size = 0;
+               for (i = 0; i < hash_index->number_of_tables; i++)
+                    imh_append_bucket(&neighbors, &hash_index->hash_tables[i], indices[i]);
+               list_sort_by_item(&neighbors);
+               list_unique(&neighbors);
+          }
+     }
+     free(cursors);
+     free(indices);
+     free(minhashes);
           
      return neighbors;
 }
 
+/**
+ * @brief Whether a score goes before another one in a ranking: higher
+ *        values first and, among equal values, lower indices first
+ */
+static inline int imhsearch_score_before(const Score *a, const Score *b)
+{
+     return a->value > b->value || (a->value == b->value && a->index < b->index);
+}
+
+/**
+ * @brief Comparison of scores for qsort (order of imhsearch_score_before)
+ */
+static int imhsearch_score_compare(const void *a, const void *b)
+{
+     if (imhsearch_score_before((const Score *) a, (const Score *) b))
+          return -1;
+     else if (imhsearch_score_before((const Score *) b, (const Score *) a))
+          return 1;
+     else
+          return 0;
+}
+
+/**
+ * @brief Moves a score down a heap whose first score is the one that goes
+ *        last in the ranking
+ *
+ * @param heap Heap of scores
+ * @param size Number of scores in the heap
+ * @param i Position of the score to move
+ */
+static void imhsearch_sift_down_score(Score *heap, uint size, uint i)
+{
+     Score score = heap[i];
+
+     while (2 * i + 1 < size) {
+          uint child = 2 * i + 1;
+          if (child + 1 < size && imhsearch_score_before(&heap[child], &heap[child + 1]))
+               child++;
+          if (!imhsearch_score_before(&score, &heap[child]))
+               break;
+          heap[i] = heap[child];
+          i = child;
+     }
+     heap[i] = score;
+}
+
+/**
+ * @brief Moves the best scores to the beginning of an array and sorts them
+ *        (see imhsearch_score_before). Keeps a heap of the best scores
+ *        seen so far, so it takes O(n log m) time instead of sorting all
+ *        of them.
+ *
+ * @param scores Array of scores
+ * @param size Number of scores
+ * @param m Number of best scores wanted
+ *
+ * @return Number of scores selected (min(m, size))
+ */
+static uint imhsearch_select_scores(Score *scores, uint size, uint m)
+{
+     uint i;
+
+     if (m > size)
+          m = size;
+     for (i = m / 2; i-- > 0;)
+          imhsearch_sift_down_score(scores, m, i);
+     for (i = m; i < size; i++) {
+          if (m > 0 && imhsearch_score_before(&scores[i], &scores[0])) {
+               scores[0] = scores[i];
+               imhsearch_sift_down_score(scores, m, 0);
+          }
+     }
+     qsort(scores, m, sizeof(Score), imhsearch_score_compare);
+
+     return m;
+}
+
+/**
+ * @brief Finds the k best neighbors of a query in two steps. Candidates
+ *        (imhsearch_query) are first ranked by their number of collisions
+ *        and only the best ones are scored with func, so the cost of
+ *        reranking does not depend on how many lists the query collided
+ *        with. Once k candidates are scored, the overlap coefficient and
+ *        the Jaccard similarity skip the ones whose size, or bit signature
+ *        if the index has signatures and the list is long enough for it to
+ *        be cheaper than its items, bounds their score below the k-th best.
+ *        Ties are broken by the lowest ID.
+ *
+ * @param query Query list
+ * @param hash_index Index structure with hash tables
+ * @param listdb Database of lists stored in the hash tables (only used for reranking)
+ * @param func Score used to rerank the candidates (e.g. list_overlap) or NULL
+ *             to rank the neighbors by their number of collisions
+ * @param k Number of neighbors
+ * @param number_of_candidates Number of candidates with most collisions
+ *                             that are reranked (at least k)
+ * @param scores Where the score of each neighbor is written (k values) or NULL
+ *
+ * @return List of at most k neighbors, best first
+ */
+List imhsearch_query_top(List *query, HashIndex *hash_index, ListDB *listdb,
+                         double (*func)(List *, List *), uint k, uint number_of_candidates,
+                         double *scores)
+{
+     uint i;
+     List candidates = imhsearch_query(query, hash_index);
+     if (number_of_candidates < k)
+          number_of_candidates = k;
+
+     Score *ranking = (Score *) malloc((candidates.size + 1) * sizeof(Score));
+     for (i = 0; i < candidates.size; i++) {
+          ranking[i].index = i;
+          ranking[i].value = candidates.data[i].freq;
+     }
+     uint size = candidates.size;
+     if (func != NULL) {
+          size = imhsearch_select_scores(ranking, size, number_of_candidates);
+          RerankQuery rerank;
+          imhsearch_rerank_init(&rerank, query, size);
+          int bounded = func == list_overlap || func == list_jaccard;
+          uint heap_size = 0;
+          uint m = k < size ? k : size;
+          for (i = 0; i < size; i++) {
+               uint id = candidates.data[ranking[i].index].item;
+               if (bounded && m > 0 && heap_size == m) {
+                    uint list_size = listdb->lists[id].size;
+                    uint bound = list_size < query->size ? list_size : query->size;
+                    if (hash_index->signatures != NULL && list_size > IMHSEARCH_SIGNATURE_MIN_SIZE) {
+                         const ullong *signature = &hash_index->signatures[(size_t) id
+                                                                           * IMHSEARCH_SIGNATURE_WORDS];
+                         bound = imhsearch_signature_bound(rerank.signature, query->size,
+                                                           signature, list_size);
+                    }
+                    if (imhsearch_similarity(bound, query->size, list_size, func) < ranking[0].value)
+                         continue;
+               }
+
+               // the scores kept so far are a heap at the beginning of the ranking
+               Score score = {imhsearch_score(&rerank, listdb, id, func), ranking[i].index};
+               if (heap_size < m) {
+                    ranking[heap_size++] = score;
+                    if (heap_size == m) {
+                         uint j;
+                         for (j = m / 2; j-- > 0;)
+                              imhsearch_sift_down_score(ranking, m, j);
+                    }
+               } else if (m > 0 && imhsearch_score_before(&score, &ranking[0])) {
+                    ranking[0] = score;
+                    imhsearch_sift_down_score(ranking, m, 0);
+               }
+          }
+          imhsearch_rerank_destroy(&rerank);
+          size = heap_size;
+     }
+     size = imhsearch_select_scores(ranking, size, k);
+
+     List neighbors = list_create(size);
+     for (i = 0; i < size; i++) {
+          neighbors.data[i] = candidates.data[ranking[i].index];
+          if (scores != NULL)
+               scores[i] = ranking[i].value;
+     }
+     free(ranking);
+     list_destroy(&candidates);
+
+     return neighbors;
+}
+
+/**
+ * @brief Computes the smallest intersection size for which two lists reach a
+ *        threshold of the overlap coefficient or the Jaccard similarity
+ *
+ * @param threshold Smallest similarity of interest
+ * @param size1 Size of the first list
+ * @param size2 Size of the second list
+ * @param func list_overlap or list_jaccard
+ *
+ * @return Smallest intersection size or a value larger than the smallest
+ *         list if the threshold cannot be reached
+ */
+static uint imhsearch_needed_intersection(double threshold, uint size1, uint size2,
+                                          double (*func)(List *, List *))
+{
+     uint min_size = min(size1, size2);
+     if (threshold <= 0.0)
+          return 0;
+     if (min_size == 0)
+          return 1;
+
+     // the estimate is corrected with the exact similarity, so rounding
+     // never drops a list that reaches the threshold
+     double estimate = func == list_overlap ? threshold * min_size
+          : threshold * (size1 + size2) / (1.0 + threshold);
+     if (estimate > min_size)
+          return min_size + 1;
+     uint needed = (uint) estimate;
+     while (needed > 0 && imhsearch_similarity(needed - 1, size1, size2, func) >= threshold)
+          needed--;
+     while (needed <= min_size && imhsearch_similarity(needed, size1, size2, func) < threshold)
+          needed++;
+
+     return needed;
+}
+
+/**
+ * @brief Finds the neighbors of a query whose similarity is at least a
+ *        threshold. For the overlap coefficient and the Jaccard similarity,
+ *        candidates whose sizes alone cannot reach the threshold are dropped
+ *        without reading their items, and so are the ones whose bit
+ *        signatures bound their overlap below the threshold, if the index
+ *        has signatures. The intersection of the others stops as soon as
+ *        the threshold cannot be reached. Other scores are computed in full.
+ *
+ * @param query Query list
+ * @param hash_index Index structure with hash tables
+ * @param listdb Database of lists stored in the hash tables
+ * @param func Score of the neighbors (e.g. list_overlap)
+ * @param threshold Smallest score of the neighbors
+ * @param scores Where an array with the score of each neighbor is stored
+ *               (to be freed by the caller) or NULL
+ *
+ * @return List of neighbors reaching the threshold, best first (ties are
+ *         broken by the lowest ID)
+ */
+List imhsearch_query_threshold(List *query, HashIndex *hash_index, ListDB *listdb,
+                               double (*func)(List *, List *), double threshold,
+                               double **scores)
+{
+     uint i, size = 0;
+     List candidates = imhsearch_query(query, hash_index);
+     int bounded = func == list_overlap || func == list_jaccard;
+     ullong signature[IMHSEARCH_SIGNATURE_WORDS];
+     if (bounded && hash_index->signatures != NULL)
+          imhsearch_compute_signature(query, signature);
+
+     Score *ranking = (Score *) malloc((candidates.size + 1) * sizeof(Score));
+     for (i = 0; i < candidates.size; i++) {
+          uint id = candidates.data[i].item;
+          double score;
+          if (bounded) {
+               uint list_size = listdb->lists[id].size;
+               uint min_size = min(query->size, list_size);
+               uint needed = imhsearch_needed_intersection(threshold, query->size, list_size, func);
+               if (needed > min_size)
+                    continue;
+               if (hash_index->signatures != NULL
+                   && imhsearch_signature_bound(signature, query->size,
+                                                &hash_index->signatures[(size_t) id
+                                                                        * IMHSEARCH_SIGNATURE_WORDS],
+                                                list_size) < needed)
+                    continue;
+
+               const uint *items = listdb_item_column(listdb, id);
+               uint intersection_size = items != NULL
+                    ? list_intersection_size_column_bounded(query, items, list_size, needed)
+                    : list_intersection_size_bounded(query, &listdb->lists[id], needed);
+               if (intersection_size < needed)
+                    continue;
+               score = imhsearch_similarity(intersection_size, query->size, list_size, func);
+          } else {
+               score = func(query, &listdb->lists[id]);
+               if (score < threshold)
+                    continue;
+          }
+          ranking[size].index = i;
+          ranking[size].value = score;
+          size++;
+     }
+     qsort(ranking, size, sizeof(Score), imhsearch_score_compare);
+
+     List neighbors = list_create(size);
+     if (scores != NULL)
+          *scores = (double *) malloc((size + 1) * sizeof(double));
+     for (i = 0; i < size; i++) {
+          neighbors.data[i] = candidates.data[ranking[i].index];
+          if (scores != NULL)
+               (*scores)[i] = ranking[i].value;
+     }
+     free(ranking);
+     list_destroy(&candidates);
+
+     return neighbors;
+}
+
 /**
  * @brief Queries the hash tables of an hash index structure with a given database of lists
  *
@@ -166,14 +1482,281 @@ List imhsearch_query(List *query, HashIndex *hash_index)
  *
  * @return Neighbors found (database of lists) for each query 
  */
-
 ListDB imhsearch_query_multi(ListDB *queries, HashIndex *hash_index)
+{
+     return imhsearch_query_parallel(queries, hash_index, NULL, NULL, 1);
+}
+
+/**
+ * @brief Work shared by the threads of a parallel batch query
+ */
+typedef struct QueryJob {
+     ListDB *queries;
+     HashIndex *hash_index;
+     ListDB *listdb;
+     double (*func)(List *, List *);
+     ListDB *neighbors;
+     double **scores;
+     uint k;
+     uint number_of_candidates;
+     double threshold;
+     uint next_query;
+} QueryJob;
+
+/**
+ * @brief Thread routine of imhsearch_query_parallel. Claims chunks of
+ *        queries from a shared counter until all of them are answered.
+ *
+ * @param arg Query job shared by all threads
+ */
+static void *imhsearch_query_worker(void *arg)
+{
+     QueryJob *job = (QueryJob *) arg;
+
+     while (1) {
+          uint first = __atomic_fetch_add(&job->next_query, IMHSEARCH_QUERY_CHUNK,
+                                          __ATOMIC_RELAXED);
+          if (first >= job->queries->size)
+               break;
+          uint last = min(first + IMHSEARCH_QUERY_CHUNK, job->queries->size);
+
+          uint i;
+          for (i = first; i < last; i++) {
+               if (job->threshold > 0.0 && job->func != NULL) {
+                    List neighbors = imhsearch_query_threshold(&job->queries->lists[i],
+                                                               job->hash_index, job->listdb,
+                                                               job->func, job->threshold,
+                                                               job->scores != NULL
+                                                               ? &job->scores[i] : NULL);
+                    if (job->k > 0 && neighbors.size > job->k)
+                         neighbors.size = job->k;
+                    job->neighbors->lists[i] = neighbors;
+                    continue;
+               }
+               if (job->k > 0) {
+                    double *scores = NULL;
+                    if (job->scores != NULL) {
+                         scores = (double *) malloc(job->k * sizeof(double));
+                         job->scores[i] = scores;
+                    }
+                    job->neighbors->lists[i] = imhsearch_query_top(&job->queries->lists[i],
+                                                                   job->hash_index, job->listdb,
+                                                                   job->func, job->k,
+                                                                   job->number_of_candidates,
+                                                                   scores);
+                    continue;
+               }
+
+               List neighbors = imhsearch_query(&job->queries->lists[i], job->hash_index);
+               double *scores = NULL;
+               if (job->scores != NULL) {
+                    scores = (double *) malloc((neighbors.size + 1) * sizeof(double));
+                    job->scores[i] = scores;
+               }
+               if (job->func != NULL) {
+                    imhsearch_sort_scored(&job->queries->lists[i], &neighbors, job->listdb,
+                                          job->func, scores);
+               } else if (scores != NULL) {
+                    uint j;
+                    for (j = 0; j < neighbors.size; j++)
+                         scores[j] = neighbors.data[j].freq;
+               }
+               job->neighbors->lists[i] = neighbors;
+          }
+     }
+
+     return NULL;
+}
+
+/**
+ * @brief Queries the hash tables of an hash index structure with a given
+ *        database of lists using several threads. Queries are handed out in
+ *        small chunks on demand, so a few expensive queries do not hold up
+ *        the rest. Each result is written to the position of its query, so
+ *        the output does not depend on the number of threads.
+ *
+ * @param queries Queries given as a database of lists 
+ * @param hash_index Index structure with hash tables
+ * @param listdb Database of lists stored in the hash tables (only used for reranking)
+ * @param func Score used to sort the neighbors of each query (e.g. list_overlap)
+ *             or NULL to leave them sorted by ID
+ * @param number_of_threads Number of threads (0 uses all online processors)
+ *
+ * @return Neighbors found (database of lists) for each query 
+ */
+ListDB imhsearch_query_parallel(ListDB *queries, HashIndex *hash_index, ListDB *listdb,
+                                double (*func)(List *, List *), uint number_of_threads)
+{
+     return imhsearch_query_scored(queries, hash_index, listdb, func, number_of_threads, NULL);
+}
+
+/**
+ * @brief Queries the hash tables of an hash index structure with a given
+ *        database of lists using several threads and keeps the score that
+ *        sorted the neighbors of each query (see imhsearch_query_parallel).
+ *
+ * @param queries Queries given as a database of lists 
+ * @param hash_index Index structure with hash tables
+ * @param listdb Database of lists stored in the hash tables
+ * @param func Score used to sort the neighbors of each query (e.g. list_overlap)
+ * @param number_of_threads Number of threads (0 uses all online processors)
+ * @param scores Array of queries->size pointers where the scores of the
+ *               neighbors of each query are stored (to be freed by the caller).
+ *               Without func, the score is the number of collisions.
+ *
+ * @return Neighbors found (database of lists) for each query 
+ */
+ListDB imhsearch_query_scored(ListDB *queries, HashIndex *hash_index, ListDB *listdb,
+                              double (*func)(List *, List *), uint number_of_threads,
+                              double **scores)
+{
+     return imhsearch_query_top_parallel(queries, hash_index, listdb, func, 0, 0, 0.0,
+                                         number_of_threads, scores);
+}
+
+/**
+ * @brief Finds the k best neighbors of each query of a database of lists
+ *        (imhsearch_query_top) or the ones whose score reaches a threshold
+ *        (imhsearch_query_threshold) using several threads, in the same way
+ *        as imhsearch_query_parallel.
+ *
+ * @param queries Queries given as a database of lists 
+ * @param hash_index Index structure with hash tables
+ * @param listdb Database of lists stored in the hash tables
+ * @param func Score used to rerank the candidates (e.g. list_overlap) or NULL
+ * @param k Number of neighbors of each query (0 keeps all of them, sorted by
+ *          func if given or by ID otherwise)
+ * @param number_of_candidates Number of candidates with most collisions
+ *                             that are reranked
+ * @param threshold Smallest score of the neighbors (0 keeps all of them).
+ *                  With a threshold, the k best neighbors reaching it are
+ *                  kept and all the candidates are verified.
+ * @param number_of_threads Number of threads (0 uses all online processors)
+ * @param scores Array of queries->size pointers where the scores of the
+ *               neighbors of each query are stored (to be freed by the caller)
+ *               or NULL. Without func, the score is the number of collisions.
+ *
+ * @return Neighbors found (database of lists) for each query 
+ */
+ListDB imhsearch_query_top_parallel(ListDB *queries, HashIndex *hash_index, ListDB *listdb,
+                                    double (*func)(List *, List *), uint k,
+                                    uint number_of_candidates, double threshold,
+                                    uint number_of_threads, double **scores)
 {
      ListDB neighbors = listdb_create(queries->size, queries->dim);
+     QueryJob job = {queries, hash_index, listdb, func, &neighbors, scores, k,
+                     number_of_candidates, threshold, 0};
+
+     if (number_of_threads == 0) {
+          long online = sysconf(_SC_NPROCESSORS_ONLN);
+          number_of_threads = online > 0 ? (uint) online : 1;
+     }
+     uint max_threads = (queries->size + IMHSEARCH_QUERY_CHUNK - 1) / IMHSEARCH_QUERY_CHUNK;
+     if (number_of_threads > max_threads)
+          number_of_threads = max_threads > 0 ? max_threads : 1;
 
+     if (number_of_threads == 1) {
+          imhsearch_query_worker(&job);
+          return neighbors;
+     }
+
+     pthread_t *threads = (pthread_t *) malloc(number_of_threads * sizeof(pthread_t));
      uint i;
-     for (i = 0; i < queries->size; i++)
-          neighbors.lists[i] = imhsearch_query(&queries->lists[i], hash_index);
+     for (i = 0; i < number_of_threads; i++) {
+          if (pthread_create(&threads[i], NULL, imhsearch_query_worker, &job) != 0) {
+               fprintf(stderr,"Error: Could not create query thread %u\n", i);
+               exit(EXIT_FAILURE);
+          }
+     }
+     for (i = 0; i < number_of_threads; i++)
+          pthread_join(threads[i], NULL);
+     free(threads);
 
      return neighbors;
 }
+
+/**
+ * @brief Queries the hash tables of an hash index structure with a batch
+ *        of queries and writes the neighbors of each query in order
+ *        (see imhsearch_query_parallel). The writer is flushed at the end,
+ *        so the results of the batch are available to whoever reads them.
+ *
+ * @param queries Batch of queries given as a database of lists
+ * @param hash_index Index structure with hash tables
+ * @param listdb Database of lists stored in the hash tables
+ * @param func Score used to sort the neighbors of each query (e.g. list_overlap)
+ * @param k Number of neighbors of each query (0 keeps all of them)
+ * @param number_of_candidates Number of candidates reranked when k is given
+ * @param threshold Smallest score of the neighbors (0 keeps all of them)
+ * @param number_of_threads Number of threads (0 uses all online processors)
+ * @param writer Writer where the neighbors are saved
+ * @param binary Whether the neighbors are saved with their scores in the binary
+ *               results format (listdb_write_scored_list) instead of as text
+ */
+void imhsearch_query_batch(ListDB *queries, HashIndex *hash_index, ListDB *listdb,
+                           double (*func)(List *, List *), uint k, uint number_of_candidates,
+                           double threshold, uint number_of_threads, ListWriter *writer,
+                           int binary)
+{
+     uint i;
+     double **scores = NULL;
+     if (binary)
+          scores = (double **) malloc((queries->size + 1) * sizeof(double *));
+
+     ListDB neighbors = imhsearch_query_top_parallel(queries, hash_index, listdb, func, k,
+                                                     number_of_candidates, threshold,
+                                                     number_of_threads, scores);
+     for (i = 0; i < neighbors.size; i++) {
+          if (binary) {
+               listdb_write_scored_list(writer, &neighbors.lists[i], scores[i]);
+               free(scores[i]);
+          } else {
+               listdb_write_list(writer, &neighbors.lists[i]);
+          }
+     }
+     listdb_writer_flush(writer);
+
+     free(scores);
+     listdb_destroy(&neighbors);
+}
+
+/**
+ * @brief Answers the queries read from a file (it can be stdin) in batches
+ *        of bounded size and writes the neighbors of each batch as soon as
+ *        it is answered, so memory does not grow with the number of queries.
+ *
+ * @param reader Reader of the file with the queries
+ * @param batch_size Maximum number of queries in memory at once
+ * @param hash_index Index structure with hash tables
+ * @param listdb Database of lists stored in the hash tables
+ * @param func Score used to sort the neighbors of each query (e.g. list_overlap)
+ * @param k Number of neighbors of each query (0 keeps all of them)
+ * @param number_of_candidates Number of candidates reranked when k is given
+ * @param threshold Smallest score of the neighbors (0 keeps all of them)
+ * @param number_of_threads Number of threads (0 uses all online processors)
+ * @param writer Writer where the neighbors are saved
+ * @param binary Whether the neighbors are saved in the binary results format
+ *
+ * @return Number of queries answered
+ */
+ullong imhsearch_query_stream(ListReader *reader, uint batch_size, HashIndex *hash_index,
+                              ListDB *listdb, double (*func)(List *, List *), uint k,
+                              uint number_of_candidates, double threshold,
+                              uint number_of_threads, ListWriter *writer, int binary)
+{
+     ullong number_of_queries = 0;
+
+     while (1) {
+          ListDB queries = listdb_read(reader, batch_size);
+          if (queries.size == 0) {
+               listdb_destroy(&queries);
+               break;
+          }
+          imhsearch_query_batch(&queries, hash_index, listdb, func, k, number_of_candidates,
+                                threshold, number_of_threads, writer, binary);
+          number_of_queries += queries.size;
+          listdb_destroy(&queries);
+     }
+
+     return number_of_queries;
+}
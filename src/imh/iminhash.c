@@ -19,10 +19,12 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <math.h>
 #include <inttypes.h>
-#include "mt64.h"
+#include "imhrng.h"
+#include "imhkernel.h"
 #include "iminhash.h"
 
 /**
@@ -44,7 +46,10 @@ void imh_print_head(HashTable *hash_table)
             hash_table->tuple_size,
             hash_table->dim,
             hash_table->sublist_size); 
-     list_print(&hash_table->used_buckets);
+     if (hash_table->offsets != NULL)
+          printf("frozen (%u IDs)\n", hash_table->offsets[hash_table->table_size]);
+     else
+          list_print(&hash_table->used_buckets);
 
      printf("a: ");
      for (i = 0; i < hash_table->tuple_size; i++)
@@ -54,6 +59,24 @@ void imh_print_head(HashTable *hash_table)
      for (i = 0; i < hash_table->tuple_size; i++)
           printf("%u ", hash_table->b[i]);
      printf("\n");
+
+     if (hash_table->scheme == IMH_SCHEME_HASHED) {
+          printf("seeds: ");
+          for (i = 0; i < hash_table->tuple_size; i++)
+               printf("%llu ", hash_table->seeds[i]);
+          printf("\n");
+     } else if (hash_table->scheme == IMH_SCHEME_OPH) {
+          printf("seed: %llu\nbins: %u-%u of %u\n",
+                 hash_table->seeds[0],
+                 hash_table->first_bin,
+                 hash_table->first_bin + hash_table->tuple_size - 1,
+                 hash_table->number_of_bins);
+     } else if (hash_table->scheme == IMH_SCHEME_RANKS) {
+          printf("ranks: columns %u-%u of %u\n",
+                 hash_table->first_bin,
+                 hash_table->first_bin + hash_table->tuple_size - 1,
+                 hash_table->rank_stride);
+     }
 }
 
 /**
@@ -63,12 +86,23 @@ void imh_print_head(HashTable *hash_table)
  */
 void imh_print_table(HashTable *hash_table)
 {
-     uint i;
+     uint i, j;
      
-     for (i = 0; i < hash_table->used_buckets.size; i++) {
-          uint bucket_number = hash_table->used_buckets.data[i].item;
-          printf("[  %d  ] ", bucket_number);
-          list_print(&hash_table->buckets[bucket_number].items);
+     if (hash_table->offsets != NULL) {
+          for (i = 0; i < hash_table->table_size; i++) {
+               if (hash_table->offsets[i + 1] > hash_table->offsets[i]) {
+                    printf("[  %d  ] %d -- ", i, hash_table->offsets[i + 1] - hash_table->offsets[i]);
+                    for (j = hash_table->offsets[i]; j < hash_table->offsets[i + 1]; j++)
+                         printf("%d:1[%d] ", hash_table->ids[j], j - hash_table->offsets[i]);
+                    printf("\n");
+               }
+          }
+     } else {
+          for (i = 0; i < hash_table->used_buckets.size; i++) {
+               uint bucket_number = hash_table->used_buckets.data[i].item;
+               printf("[  %d  ] ", bucket_number);
+               list_print(&hash_table->buckets[bucket_number].items);
+          }
      }
 }
 
@@ -84,9 +118,19 @@ void imh_init_table(HashTable *hash_table)
      hash_table->tuple_size = 0;
      hash_table->sublist_size = 0; 
      hash_table->dim = 0; 
+     hash_table->scheme = IMH_SCHEME_PERMUTATIONS;
      hash_table->permutations  = NULL; 
+     hash_table->seeds = NULL;
+     hash_table->number_of_bins = 0;
+     hash_table->first_bin = 0;
+     hash_table->ranks = NULL;
+     hash_table->rank_stride = 0;
      hash_table->buckets = NULL;
      list_init(&hash_table->used_buckets);
+     hash_table->keys = NULL;
+     hash_table->offsets = NULL;
+     hash_table->ids = NULL;
+     hash_table->counts = NULL;
      hash_table->a = NULL;
      hash_table->b = NULL;
 }
@@ -96,7 +140,7 @@ void imh_init_table(HashTable *hash_table)
  */
 void imh_init_rng(unsigned long long seed)
 {
-     init_genrand64(seed);
+     imhrng_init(imhrng_global(), seed, 0);
 }
 
 /**
@@ -107,11 +151,12 @@ void imh_init_rng(unsigned long long seed)
  * @param dim Largest item value in the database of lists
  * @param table_size Number of buckets in the hash table
  * @param sublist_size Size of sublists
+ * @param rng Stream of random values
  *
  * @return Hash table structure
  */
-HashTable imh_create_table(uint table_size, uint tuple_size, uint dim,
-                           uint sublist_size)
+HashTable imh_create_table_r(uint table_size, uint tuple_size, uint dim,
+                             uint sublist_size, RandomStream *rng)
 {
      uint i;
      HashTable hash_table;
@@ -120,23 +165,262 @@ HashTable imh_create_table(uint table_size, uint tuple_size, uint dim,
      hash_table.tuple_size = tuple_size; 
      hash_table.dim = dim;
      hash_table.sublist_size = sublist_size; 
+     hash_table.scheme = IMH_SCHEME_PERMUTATIONS;
      hash_table.permutations = (RandomValue *) malloc(tuple_size * dim *
                                                       sizeof(RandomValue));
+     hash_table.seeds = NULL;
+     hash_table.number_of_bins = 0;
+     hash_table.first_bin = 0;
+     hash_table.ranks = NULL;
+     hash_table.rank_stride = 0;
+    
+     hash_table.buckets = NULL; // allocated by the first imh_store_tuple
+     list_init(&hash_table.used_buckets);
+     hash_table.keys = NULL;
+     hash_table.offsets = NULL;
+     hash_table.ids = NULL;
+     hash_table.counts = NULL;
+
+     // generates array of random values for universal hashing
+     hash_table.a = (uint *) malloc(tuple_size * sizeof(uint));
+     hash_table.b = (uint *) malloc(tuple_size * sizeof(uint));
+     for (i = 0; i < tuple_size; i++) {
+          hash_table.a[i] = (unsigned int) (imhrng_next(rng) & 0xFFFFFFFF);
+          hash_table.b[i] = (unsigned int) (imhrng_next(rng) & 0xFFFFFFFF);
+     }
+     
+     return hash_table;
+}
+
+/**
+ * @brief Creates a hash table structure drawing its random values
+ *        from the global generator (see imh_create_table_r)
+ */
+HashTable imh_create_table(uint table_size, uint tuple_size, uint dim,
+                           uint sublist_size)
+{
+     return imh_create_table_r(table_size, tuple_size, dim, sublist_size,
+                               imhrng_global());
+}
+
+/**
+ * @brief Creates a hash table structure whose MinHash values are computed
+ *        from a seeded hash of the items instead of an array of random values.
+ *        Only one seed per tuple position is stored, so memory does not
+ *        depend on the dimensionality.
+ *
+ * @param Number of MinHash values per tuple
+ * @param dim Largest item value in the database of lists
+ * @param table_size Number of buckets in the hash table
+ * @param sublist_size Size of sublists
+ * @param rng Stream of random values
+ *
+ * @return Hash table structure
+ */
+HashTable imh_create_table_hashed_r(uint table_size, uint tuple_size, uint dim,
+                                    uint sublist_size, RandomStream *rng)
+{
+     uint i;
+     HashTable hash_table;
+
+     hash_table.table_size = table_size;
+     hash_table.tuple_size = tuple_size; 
+     hash_table.dim = dim;
+     hash_table.sublist_size = sublist_size; 
+     hash_table.scheme = IMH_SCHEME_HASHED;
+     hash_table.permutations = NULL;
+     hash_table.number_of_bins = 0;
+     hash_table.first_bin = 0;
+     hash_table.ranks = NULL;
+     hash_table.rank_stride = 0;
+    
+     hash_table.buckets = NULL; // allocated by the first imh_store_tuple
+     list_init(&hash_table.used_buckets);
+     hash_table.keys = NULL;
+     hash_table.offsets = NULL;
+     hash_table.ids = NULL;
+     hash_table.counts = NULL;
+
+     // generates array of random values for universal hashing
+     hash_table.a = (uint *) malloc(tuple_size * sizeof(uint));
+     hash_table.b = (uint *) malloc(tuple_size * sizeof(uint));
+     for (i = 0; i < tuple_size; i++) {
+          hash_table.a[i] = (unsigned int) (imhrng_next(rng) & 0xFFFFFFFF);
+          hash_table.b[i] = (unsigned int) (imhrng_next(rng) & 0xFFFFFFFF);
+     }
+
+     // generates one seed for each MinHash function
+     hash_table.seeds = (ullong *) malloc(tuple_size * sizeof(ullong));
+     for (i = 0; i < tuple_size; i++)
+          hash_table.seeds[i] = imhrng_next(rng);
+     
+     return hash_table;
+}
+
+/**
+ * @brief Creates a hash table structure drawing its random values
+ *        from the global generator (see imh_create_table_hashed_r)
+ */
+HashTable imh_create_table_hashed(uint table_size, uint tuple_size, uint dim,
+                                  uint sublist_size)
+{
+     return imh_create_table_hashed_r(table_size, tuple_size, dim, sublist_size,
+                                      imhrng_global());
+}
+
+/**
+ * @brief Creates a hash table structure whose tuple is taken from a
+ *        range of bins of a one permutation hashing signature shared by
+ *        all the tables of an index.
+ *
+ * @param Number of MinHash values per tuple
+ * @param dim Largest item value in the database of lists
+ * @param table_size Number of buckets in the hash table
+ * @param sublist_size Size of sublists
+ * @param seed Seed of the hash function shared by all tables
+ * @param number_of_bins Number of bins of the signature
+ * @param first_bin First bin of the signature used by the table
+ * @param rng Stream of random values
+ *
+ * @return Hash table structure
+ */
+HashTable imh_create_table_oph_r(uint table_size, uint tuple_size, uint dim,
+                                 uint sublist_size, ullong seed, uint number_of_bins,
+                                 uint first_bin, RandomStream *rng)
+{
+     uint i;
+     HashTable hash_table;
+
+     hash_table.table_size = table_size;
+     hash_table.tuple_size = tuple_size; 
+     hash_table.dim = dim;
+     hash_table.sublist_size = sublist_size; 
+     hash_table.scheme = IMH_SCHEME_OPH;
+     hash_table.permutations = NULL;
+     hash_table.number_of_bins = number_of_bins;
+     hash_table.first_bin = first_bin;
+     hash_table.ranks = NULL;
+     hash_table.rank_stride = 0;
+    
+     hash_table.buckets = NULL; // allocated by the first imh_store_tuple
+     list_init(&hash_table.used_buckets);
+     hash_table.keys = NULL;
+     hash_table.offsets = NULL;
+     hash_table.ids = NULL;
+     hash_table.counts = NULL;
+
+     // generates array of random values for universal hashing
+     hash_table.a = (uint *) malloc(tuple_size * sizeof(uint));
+     hash_table.b = (uint *) malloc(tuple_size * sizeof(uint));
+     for (i = 0; i < tuple_size; i++) {
+          hash_table.a[i] = (unsigned int) (imhrng_next(rng) & 0xFFFFFFFF);
+          hash_table.b[i] = (unsigned int) (imhrng_next(rng) & 0xFFFFFFFF);
+     }
+
+     hash_table.seeds = (ullong *) malloc(sizeof(ullong));
+     hash_table.seeds[0] = seed;
+     
+     return hash_table;
+}
+
+/**
+ * @brief Creates a hash table structure drawing its random values
+ *        from the global generator (see imh_create_table_oph_r)
+ */
+HashTable imh_create_table_oph(uint table_size, uint tuple_size, uint dim,
+                               uint sublist_size, ullong seed, uint number_of_bins,
+                               uint first_bin)
+{
+     return imh_create_table_oph_r(table_size, tuple_size, dim, sublist_size, seed,
+                                   number_of_bins, first_bin, imhrng_global());
+}
+
+/**
+ * @brief Creates a hash table structure whose tuple is taken from a range
+ *        of columns of an item-major store of ranks shared by all the tables
+ *        of an index. The table does not own the rank store.
+ *
+ * @param Number of MinHash values per tuple
+ * @param dim Largest item value in the database of lists
+ * @param table_size Number of buckets in the hash table
+ * @param sublist_size Size of sublists
+ * @param ranks Rank store (one row of rank_stride ranks per item)
+ * @param rank_stride Number of ranks per row
+ * @param first_bin First column of the rank store used by the table
+ * @param rng Stream of random values
+ *
+ * @return Hash table structure
+ */
+HashTable imh_create_table_ranks_r(uint table_size, uint tuple_size, uint dim,
+                                   uint sublist_size, uint *ranks, uint rank_stride,
+                                   uint first_bin, RandomStream *rng)
+{
+     uint i;
+     HashTable hash_table;
+
+     hash_table.table_size = table_size;
+     hash_table.tuple_size = tuple_size; 
+     hash_table.dim = dim;
+     hash_table.sublist_size = sublist_size; 
+     hash_table.scheme = IMH_SCHEME_RANKS;
+     hash_table.permutations = NULL;
+     hash_table.seeds = NULL;
+     hash_table.number_of_bins = 0;
+     hash_table.first_bin = first_bin;
+     hash_table.ranks = ranks;
+     hash_table.rank_stride = rank_stride;
     
-     hash_table.buckets = (Bucket *) calloc(table_size, sizeof(Bucket));
+     hash_table.buckets = NULL; // allocated by the first imh_store_tuple
      list_init(&hash_table.used_buckets);
+     hash_table.keys = NULL;
+     hash_table.offsets = NULL;
+     hash_table.ids = NULL;
+     hash_table.counts = NULL;
 
      // generates array of random values for universal hashing
      hash_table.a = (uint *) malloc(tuple_size * sizeof(uint));
      hash_table.b = (uint *) malloc(tuple_size * sizeof(uint));
      for (i = 0; i < tuple_size; i++) {
-          hash_table.a[i] = (unsigned int) (genrand64_int64() & 0xFFFFFFFF);
-          hash_table.b[i] = (unsigned int) (genrand64_int64() & 0xFFFFFFFF);
+          hash_table.a[i] = (unsigned int) (imhrng_next(rng) & 0xFFFFFFFF);
+          hash_table.b[i] = (unsigned int) (imhrng_next(rng) & 0xFFFFFFFF);
      }
      
      return hash_table;
 }
 
+/**
+ * @brief Creates a hash table structure drawing its random values
+ *        from the global generator (see imh_create_table_ranks_r)
+ */
+HashTable imh_create_table_ranks(uint table_size, uint tuple_size, uint dim,
+                                 uint sublist_size, uint *ranks, uint rank_stride,
+                                 uint first_bin)
+{
+     return imh_create_table_ranks_r(table_size, tuple_size, dim, sublist_size, ranks,
+                                     rank_stride, first_bin, imhrng_global());
+}
+
+/**
+ * @brief Gets the name of a MinHash scheme
+ *
+ * @param scheme MinHash scheme
+ *
+ * @return Name of the scheme
+ */
+const char *imh_scheme_name(uint scheme)
+{
+     switch (scheme) {
+     case IMH_SCHEME_HASHED:
+          return "hashed";
+     case IMH_SCHEME_OPH:
+          return "oph";
+     case IMH_SCHEME_RANKS:
+          return "ranks";
+     default:
+          return "permutations";
+     }
+}
+
 /**
  * @brief Destroys a hash table structure 
  *
@@ -144,14 +428,172 @@ HashTable imh_create_table(uint table_size, uint tuple_size, uint dim,
  */
 void imh_destroy_table(HashTable *hash_table)
 {
+     uint i;
+
+     if (hash_table->buckets != NULL)
+          for (i = 0; i < hash_table->used_buckets.size; i++)
+               list_destroy(&hash_table->buckets[hash_table->used_buckets.data[i].item].items);
+
      free(hash_table->permutations);
+     free(hash_table->seeds);
      free(hash_table->buckets);
+     free(hash_table->keys);
+     free(hash_table->offsets);
+     free(hash_table->ids);
+     free(hash_table->counts);
      free(hash_table->a);
      free(hash_table->b);
      list_destroy(&hash_table->used_buckets);
      imh_init_table(hash_table);
 }
 
+/**
+ * @brief Freezes a built hash table into a compressed layout: the hash value
+ *        of each bucket, the offset of each bucket and the IDs of all the
+ *        buckets stored contiguously as 32-bit values. The buckets and the
+ *        list of used buckets are released, so nothing else can be stored
+ *        in the table afterwards.
+ *
+ * @param hash_table Hash table structure
+ */
+void imh_freeze_table(HashTable *hash_table)
+{
+     uint i, j;
+     uint number_of_ids = 0;
+
+     if (hash_table->offsets != NULL)
+          return;
+
+     for (i = 0; i < hash_table->used_buckets.size; i++)
+          number_of_ids += hash_table->buckets[hash_table->used_buckets.data[i].item].items.size;
+
+     hash_table->keys = (uint *) calloc(hash_table->table_size, sizeof(uint));
+     hash_table->offsets = (uint *) malloc((hash_table->table_size + 1) * sizeof(uint));
+     hash_table->ids = (uint *) malloc(number_of_ids * sizeof(uint));
+
+     number_of_ids = 0;
+     for (i = 0; i < hash_table->table_size; i++) {
+          hash_table->offsets[i] = number_of_ids;
+          if (hash_table->buckets == NULL) // nothing was stored
+               continue;
+          Bucket *bucket = &hash_table->buckets[i];
+          if (bucket->items.size > 0) {
+               hash_table->keys[i] = (uint) bucket->hash_value;
+               for (j = 0; j < bucket->items.size; j++)
+                    hash_table->ids[number_of_ids++] = bucket->items.data[j].item;
+               list_destroy(&bucket->items);
+          }
+     }
+     hash_table->offsets[hash_table->table_size] = number_of_ids;
+
+     free(hash_table->buckets);
+     hash_table->buckets = NULL;
+     list_destroy(&hash_table->used_buckets);
+}
+
+/**
+ * @brief Prepares an empty hash table to be built straight into the
+ *        compressed layout (see imh_freeze_table) in two passes over the
+ *        same tuples: a counting pass (imh_count_tuple) that claims the
+ *        buckets and counts their IDs and, after imh_start_filling has laid
+ *        out the IDs, a filling pass (imh_fill_tuple) that writes them in
+ *        place. No memory is allocated per stored ID.
+ *
+ * @param hash_table Hash table structure
+ */
+void imh_start_counting(HashTable *hash_table)
+{
+     if (hash_table->keys != NULL || hash_table->used_buckets.size > 0) {
+          fprintf(stderr,"Error: Only empty hash tables can be built by counting!\n");
+          exit(EXIT_FAILURE);
+     }
+
+     hash_table->keys = (uint *) calloc(hash_table->table_size, sizeof(uint));
+     hash_table->counts = (uint *) calloc(hash_table->table_size, sizeof(uint));
+}
+
+/**
+ * @brief Counts a tuple in the bucket that will hold it, claiming the first
+ *        empty bucket in its probe sequence if needed, exactly like
+ *        imh_get_index_tuple does.
+ *
+ * @param minhashes MinHash values of the tuple
+ * @param hash_table Hash table structure (being counted)
+ */
+void imh_count_tuple(ullong *minhashes, HashTable *hash_table)
+{
+     uint checked_buckets, index, hash_value;
+
+     imh_hash_tuple(minhashes, hash_table, &hash_value, &index);
+     for (checked_buckets = 0; checked_buckets < hash_table->table_size; checked_buckets++) {
+          if (hash_table->counts[index] == 0) {
+               hash_table->keys[index] = hash_value;
+               hash_table->counts[index] = 1;
+               return;
+          }
+          if (hash_table->keys[index] == hash_value) {
+               hash_table->counts[index]++;
+               return;
+          }
+          index = ((index + 1) & (hash_table->table_size - 1));
+     }
+
+     fprintf(stderr,"Error: The hash table is full!\n ");
+     exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Computes the offset of each bucket from the counts (prefix sum)
+ *        and allocates the IDs of all the buckets at once
+ *
+ * @param hash_table Hash table structure (counted)
+ */
+void imh_start_filling(HashTable *hash_table)
+{
+     uint i;
+     uint number_of_ids = 0;
+
+     hash_table->offsets = (uint *) malloc((hash_table->table_size + 1) * sizeof(uint));
+     for (i = 0; i < hash_table->table_size; i++) {
+          hash_table->offsets[i] = number_of_ids;
+          number_of_ids += hash_table->counts[i];
+          hash_table->counts[i] = 0; // reused as the number of IDs filled
+     }
+     hash_table->offsets[hash_table->table_size] = number_of_ids;
+     hash_table->ids = (uint *) malloc(number_of_ids * sizeof(uint));
+}
+
+/**
+ * @brief Writes an ID in the bucket of a tuple counted before
+ *
+ * @param minhashes MinHash values of the tuple
+ * @param id ID to be stored
+ * @param hash_table Hash table structure (being filled)
+ */
+void imh_fill_tuple(ullong *minhashes, uint id, HashTable *hash_table)
+{
+     uint index = imh_find_index_tuple(minhashes, hash_table);
+
+     if (index == IMH_NO_BUCKET) {
+          fprintf(stderr,"Error: A tuple was filled but not counted!\n");
+          exit(EXIT_FAILURE);
+     }
+
+     hash_table->ids[hash_table->offsets[index] + hash_table->counts[index]++] = id;
+}
+
+/**
+ * @brief Releases the counts used to fill a hash table. The table ends up
+ *        in the same state as if it had been stored and frozen.
+ *
+ * @param hash_table Hash table structure (filled)
+ */
+void imh_finish_filling(HashTable *hash_table)
+{
+     free(hash_table->counts);
+     hash_table->counts = NULL;
+}
+
 /**
  * @brief Comparison of random double values for bsearch and qsort. 
  *
@@ -242,26 +684,159 @@ int imh_random_int_value_compare_back(const void *a, const void *b)
  * @param dim Largest item value in the database of lists
  * @param tuple_size Number of MinHash values per tuple
  * @param permutations Random positive integers assigned to each possible item 
+ * @param rng Stream of random values
+ */
+void imh_generate_permutations_r(uint dim, uint tuple_size,
+                                 RandomValue *permutations, RandomStream *rng)
+{
+     uint i, j, k;
+     ullong int_rnd[IMH_RNG_BLOCK];
+
+     // generates random permutations by assigning a random value to each item
+     // of the universal set, drawing the values in blocks
+     for (i = 0; i < tuple_size; i++) { 
+          for (j = 0; j < dim; j += IMH_RNG_BLOCK) {
+               uint block = min(IMH_RNG_BLOCK, dim - j);
+               imhrng_fill(rng, int_rnd, block);
+               for (k = 0; k < block; k++) {
+                    permutations[i * dim + j + k].random_int = int_rnd[k];
+                    permutations[i * dim + j + k].random_double = (int_rnd[k] >> 11)
+                         * (1.0 / MAX_SAFE_INT);
+               }
+          }
+     }
+}
+
+/**
+ * @brief Generates random permutations drawing from the global generator
+ *        (see imh_generate_permutations_r)
  */
 void imh_generate_permutations(uint dim, uint tuple_size,
                                RandomValue *permutations)
+{
+     imh_generate_permutations_r(dim, tuple_size, permutations, imhrng_global());
+}
+
+/**
+ * @brief Computes the number of ranks per row of a rank store, padded so
+ *        that every row starts at a cache line boundary.
+ *
+ * @param number_of_columns Number of MinHash functions in the store
+ *
+ * @return Number of ranks per row
+ */
+uint imh_get_rank_stride(uint number_of_columns)
+{
+     uint per_line = IMH_RANKS_ALIGNMENT / sizeof(uint);
+
+     return ((number_of_columns + per_line - 1) / per_line) * per_line;
+}
+
+/**
+ * @brief Allocates an item-major rank store with rows aligned to cache lines
+ *
+ * @param dim Largest item value in the database of lists
+ * @param rank_stride Number of ranks per row
+ *
+ * @return Rank store
+ */
+uint *imh_create_ranks(uint dim, uint rank_stride)
+{
+     void *ranks;
+
+     if (posix_memalign(&ranks, IMH_RANKS_ALIGNMENT,
+                        (size_t) dim * rank_stride * sizeof(uint)) != 0) {
+          fprintf(stderr,"Error: Could not allocate the rank store!\n");
+          exit(EXIT_FAILURE);
+     }
+
+     return (uint *) ranks;
+}
+
+/**
+ * @brief Assigns, for a range of MinHash functions, a random 32-bit rank to
+ *        each possible item. All the ranks of an item are stored contiguously,
+ *        so that hashing an item for every table touches a single row.
+ *        Different ranges can be generated at once by different threads.
+ * 
+ * @param dim Largest item value in the database of lists
+ * @param first_column First MinHash function of the range
+ * @param number_of_columns Number of MinHash functions in the range
+ * @param rank_stride Number of ranks per row
+ * @param ranks Rank store
+ * @param rng Stream of random values
+ */
+void imh_generate_ranks_r(uint dim, uint first_column, uint number_of_columns,
+                          uint rank_stride, uint *ranks, RandomStream *rng)
 {
      uint i, j;
-     ullong int_rnd;
-     double dbl_rnd;
+     ullong int_rnd[(number_of_columns + 1) / 2];
 
-     // generates random permutations by assigning a random value to each item
-     // of the universal set
-     for (i = 0; i < tuple_size; i++) { 
-          for (j = 0; j < dim; j++) {
-               int_rnd = genrand64_int64();
-               dbl_rnd = (int_rnd >> 11) * (1.0 / MAX_SAFE_INT);
-               permutations[i * dim + j].random_int = int_rnd;
-               permutations[i * dim + j].random_double = dbl_rnd;
+     // each 64-bit value gives the ranks of two columns
+     for (i = 0; i < dim; i++) {
+          uint *row = ranks + (size_t) i * rank_stride + first_column;
+          imhrng_fill(rng, int_rnd, (number_of_columns + 1) / 2);
+          for (j = 0; j < number_of_columns; j++) {
+               if ((j & 1) == 0)
+                    row[j] = (uint) (int_rnd[j / 2] >> 32);
+               else
+                    row[j] = (uint) (int_rnd[j / 2] & 0xFFFFFFFF);
           }
      }
 }
 
+/**
+ * @brief Sets the padding at the end of every row of a rank store to the
+ *        largest rank, so it never wins a minimum
+ * 
+ * @param dim Largest item value in the database of lists
+ * @param number_of_columns Number of MinHash functions in the store
+ * @param rank_stride Number of ranks per row
+ * @param ranks Rank store
+ */
+void imh_pad_ranks(uint dim, uint number_of_columns, uint rank_stride, uint *ranks)
+{
+     uint i, j;
+
+     for (i = 0; i < dim; i++)
+          for (j = number_of_columns; j < rank_stride; j++)
+               ranks[(size_t) i * rank_stride + j] = LARGEST_INT;
+}
+
+/**
+ * @brief Assigns, for each MinHash function, a random 32-bit rank to each
+ *        possible item drawing from the global generator and pads the rows.
+ * 
+ * @param dim Largest item value in the database of lists
+ * @param number_of_columns Number of MinHash functions
+ * @param rank_stride Number of ranks per row (padding is set to the largest rank)
+ * @param ranks Rank store
+ */
+void imh_generate_ranks(uint dim, uint number_of_columns, uint rank_stride, uint *ranks)
+{
+     imh_generate_ranks_r(dim, 0, number_of_columns, rank_stride, ranks, imhrng_global());
+     imh_pad_ranks(dim, number_of_columns, rank_stride, ranks);
+}
+
+/**
+ * @brief Computes the random value assigned to an item by a seeded hash
+ *        (output function of SplitMix64 at position item + 1 of the seed)
+ * 
+ * @param seed Seed of the MinHash function
+ * @param item Item to be hashed
+ *
+ * @returns Random 64-bit value assigned to the item
+ */
+ullong imh_hash_item(ullong seed, uint item)
+{
+     ullong z = seed + ((ullong) item + 1) * IMHKERNEL_GAMMA;
+
+     z = (z ^ (z >> 30)) * IMHKERNEL_MIX1;
+     z = (z ^ (z >> 27)) * IMHKERNEL_MIX2;
+
+     return z ^ (z >> 31);
+}
+
 /**
  * @brief Compues the MinHash as the integer value which corresponds to the smallest real value from
  *        a given permutation.
@@ -271,7 +846,7 @@ void imh_generate_permutations(uint dim, uint tuple_size,
  *
  * @returns MinHash value
  */
-ullong imh_compute_minhash(List *list, RandomValue *permutation)
+ullong imh_compute_minhash_permutation(List *list, RandomValue *permutation)
 {
      uint i;
 
@@ -290,28 +865,225 @@ ullong imh_compute_minhash(List *list, RandomValue *permutation)
 }
 
 /**
- * @brief Universal hashing for getting a hash table index from the
- *        corresponding minhash tuple
+ * @brief Computes the MinHash as the smallest seeded hash value of the
+ *        items in a list.
+ * 
+ * @param list List to be hashed
+ * @param seed Seed of the MinHash function
  *
+ * @returns MinHash value
+ */
+ullong imh_compute_minhash_hashed(List *list, ullong seed)
+{
+     uint i;
+     ullong hash;
+     ullong min_hash = imh_hash_item(seed, list->data[0].item);
+
+     for (i = 1; i < list->size; i++) {
+          hash = imh_hash_item(seed, list->data[i].item);
+          if (min_hash > hash)
+               min_hash = hash;
+     }
+     
+     return min_hash;
+}
+
+/**
+ * @brief Bin of a one permutation hashing signature given by a hash value
+ */
+static inline uint imh_oph_bin(ullong hash, uint number_of_bins)
+{
+     return (uint) (((hash >> 32) * number_of_bins) >> 32);
+}
+
+/**
+ * @brief Computes a one permutation hashing signature of a list with
+ *        optimal densification: every item is hashed once and falls in one
+ *        of the bins, each bin keeps its minimum hash value and every empty
+ *        bin borrows the value of the first non-empty bin found by its own
+ *        sequence of random probes (Shrivastava, ICML 2017).
+ * 
+ * @param list List to be hashed
+ * @param seed Seed of the hash function
+ * @param number_of_bins Number of bins of the signature
+ * @param bins Signature (one MinHash value per bin)
+ */
+void imh_compute_oph(List *list, ullong seed, uint number_of_bins, ullong *bins)
+{
+     imh_compute_oph_range(list, seed, number_of_bins, 0, number_of_bins, bins);
+}
+
+/**
+ * @brief Computes a range of bins of a one permutation hashing signature
+ *        (see imh_compute_oph) without computing the others. The probes of
+ *        an empty bin come from a stream of its own, given by the seed and
+ *        the number of the bin. The empty bins of the range that borrow the
+ *        value of a bin outside it get it from one more pass over the items,
+ *        so a list is hashed at most twice.
+ * 
+ * @param list List to be hashed
+ * @param seed Seed of the hash function
+ * @param number_of_bins Number of bins of the signature
+ * @param first_bin First bin of the range
+ * @param number_of_values Number of bins of the range
+ * @param bins MinHash value of each bin of the range
+ */
+void imh_compute_oph_range(List *list, ullong seed, uint number_of_bins, uint first_bin,
+                           uint number_of_values, ullong *bins)
+{
+     uint i, j, attempt, borrowed = 0;
+     uint words = number_of_bins / 64 + 1;
+     ullong filled[words], wanted[words];
+     uint sources[number_of_values + 1]; // bin whose value each bin of the range takes
+
+     memset(filled, 0, words * sizeof(ullong));
+     memset(wanted, 0, words * sizeof(ullong));
+     for (i = 0; i < number_of_values; i++)
+          bins[i] = LARGEST_INT64;
+     
+     // one pass over the items
+     for (i = 0; i < list->size; i++) {
+          ullong hash = imh_hash_item(seed, list->data[i].item);
+          uint bin = imh_oph_bin(hash, number_of_bins);
+          filled[bin >> 6] |= 1ULL << (bin & 63);
+          if (bin - first_bin < number_of_values && bins[bin - first_bin] > hash)
+               bins[bin - first_bin] = hash;
+     }
+
+     // densification of empty bins
+     if (list->size == 0)
+          return;
+     for (i = 0; i < number_of_values; i++) {
+          uint bin = first_bin + i;
+          sources[i] = bin;
+          if ((filled[bin >> 6] >> (bin & 63)) & 1)
+               continue;
+          ullong key = imhrng_key(seed, bin);
+          for (attempt = 0; ; attempt++) {
+               uint probe = imh_oph_bin(imh_hash_item(key, attempt), number_of_bins);
+               if ((filled[probe >> 6] >> (probe & 63)) & 1) {
+                    sources[i] = probe;
+                    if (probe - first_bin < number_of_values) {
+                         bins[i] = bins[probe - first_bin];
+                    } else {
+                         wanted[probe >> 6] |= 1ULL << (probe & 63);
+                         borrowed++;
+                    }
+                    break;
+               }
+          }
+     }
+
+     // minimum of the bins outside the range that are borrowed
+     if (borrowed > 0) {
+          for (i = 0; i < list->size; i++) {
+               ullong hash = imh_hash_item(seed, list->data[i].item);
+               uint bin = imh_oph_bin(hash, number_of_bins);
+               if (((wanted[bin >> 6] >> (bin & 63)) & 1) == 0)
+                    continue;
+               for (j = 0; j < number_of_values; j++)
+                    if (sources[j] == bin && bins[j] > hash)
+                         bins[j] = hash;
+          }
+     }
+}
+
+/**
+ * @brief Computes the MinHash value of a list for a given tuple position 
+ *        of a hash table, regardless of how its random values are generated.
+ * 
+ * @param list List to be hashed
+ * @param hash_table Hash table structure
+ * @param position Position of the MinHash value in the tuple
+ *
+ * @returns MinHash value
+ */
+ullong imh_compute_minhash(List *list, HashTable *hash_table, uint position)
+{
+     if (hash_table->scheme == IMH_SCHEME_HASHED) {
+          return imh_compute_minhash_hashed(list, hash_table->seeds[position]);
+     } else if (hash_table->scheme == IMH_SCHEME_RANKS) {
+          uint i;
+          uint column = hash_table->first_bin + position;
+          ullong minhash = LARGEST_INT;
+          for (i = 0; i < list->size; i++) {
+               uint rank = hash_table->ranks[(size_t) list->data[i].item * hash_table->rank_stride
+                                             + column];
+               if (minhash > rank)
+                    minhash = rank;
+          }
+          return minhash;
+     } else if (hash_table->scheme == IMH_SCHEME_OPH) {
+          ullong minhash;
+          imh_compute_oph_range(list, hash_table->seeds[0], hash_table->number_of_bins,
+                                hash_table->first_bin + position, 1, &minhash);
+          return minhash;
+     } else
+          return imh_compute_minhash_permutation(list,
+                                                 &hash_table->permutations[position * hash_table->dim]);
+}
+
+/**
+ * @brief Computes all the MinHash values of the tuple of a hash table 
+ *        in one sweep over the items of a list.
+ * 
  * @param list List to be hashed
  * @param hash_table Hash table structure
+ * @param minhashes MinHash values of the tuple
+ */
+void imh_compute_tuple(List *list, const HashTable *hash_table, ullong *minhashes)
+{
+     uint i, j;
+
+     if (hash_table->scheme == IMH_SCHEME_HASHED) {
+          imhkernel_minhash_hashed(list, hash_table->seeds, hash_table->tuple_size, minhashes);
+     } else if (hash_table->scheme == IMH_SCHEME_RANKS) {
+          imhkernel_minhash_ranks(list, hash_table->ranks, hash_table->rank_stride,
+                                  hash_table->first_bin, hash_table->tuple_size, minhashes);
+     } else if (hash_table->scheme == IMH_SCHEME_OPH) {
+          imh_compute_oph_range(list, hash_table->seeds[0], hash_table->number_of_bins,
+                                hash_table->first_bin, hash_table->tuple_size, minhashes);
+     } else if (list->size > 0) {
+          uint dim = hash_table->dim;
+          double min_double[hash_table->tuple_size];
+
+          for (j = 0; j < hash_table->tuple_size; j++) {
+               RandomValue *value = &hash_table->permutations[j * dim + list->data[0].item];
+               minhashes[j] = value->random_int;
+               min_double[j] = value->random_double;
+          }
+
+          for (i = 1; i < list->size; i++) {
+               for (j = 0; j < hash_table->tuple_size; j++) {
+                    RandomValue *value = &hash_table->permutations[j * dim + list->data[i].item];
+                    if (min_double[j] > value->random_double) {
+                         minhashes[j] = value->random_int;
+                         min_double[j] = value->random_double;
+                    }
+               }
+          }
+     }
+}
+
+/**
+ * @brief Universal hashing for getting a hash table index from a
+ *        minhash tuple
+ *
+ * @param minhashes MinHash values of the tuple
+ * @param hash_table Hash table structure
  * @param hash_value Hash value
  * @param index Table index
  */
-void imh_compute_univhash(List *list, HashTable *hash_table, uint *hash_value,
-                          uint *index)
+void imh_hash_tuple(ullong *minhashes, const HashTable *hash_table, uint *hash_value,
+                    uint *index)
 {
      uint i;
-     ullong minhash;
      __uint128_t temp_index = 0;
      __uint128_t temp_hv = 0;
 
-     // computes MinHash values
      for (i = 0; i < hash_table->tuple_size; i++) {
-          uint perm = i * hash_table->dim;
-          minhash = imh_compute_minhash(list, &hash_table->permutations[perm]);
-          temp_index += ((ullong) hash_table->a[i]) * minhash;
-          temp_hv += ((ullong) hash_table->b[i]) * minhash; 
+          temp_index += ((ullong) hash_table->a[i]) * minhashes[i];
+          temp_hv += ((ullong) hash_table->b[i]) * minhashes[i]; 
      }
      
      // computes 2nd-level hash value and index (universal hash functions)
@@ -320,19 +1092,40 @@ void imh_compute_univhash(List *list, HashTable *hash_table, uint *hash_value,
 }
 
 /**
- * @brief Computes 2nd-level hash value of lists using open 
- *        adressing collision resolution and linear probing.
+ * @brief Universal hashing for getting a hash table index from the
+ *        corresponding minhash tuple
  *
  * @param list List to be hashed
  * @param hash_table Hash table structure
+ * @param hash_value Hash value
+ * @param index Table index
+ */
+void imh_compute_univhash(List *list, HashTable *hash_table, uint *hash_value,
+                          uint *index)
+{
+     ullong minhashes[hash_table->tuple_size];
+
+     imh_compute_tuple(list, hash_table, minhashes);
+     imh_hash_tuple(minhashes, hash_table, hash_value, index);
+}
+
+/**
+ * @brief Computes 2nd-level hash value of a minhash tuple using open 
+ *        adressing collision resolution and linear probing. If no bucket
+ *        holds the tuple, the first empty bucket found is claimed for it,
+ *        so this is only meant for storing lists (see imh_find_index_tuple).
+ *
+ * @param minhashes MinHash values of the tuple
+ * @param hash_table Hash table structure
  *
  * @return Index of the hash table
  */ 
-uint imh_get_index(List *list, HashTable *hash_table)
+uint imh_get_index_tuple(ullong *minhashes, HashTable *hash_table)
 {
      uint checked_buckets, index, hash_value;
      
-     imh_compute_univhash(list, hash_table, &hash_value, &index);
+     imh_hash_tuple(minhashes, hash_table, &hash_value, &index);
+
      if (hash_table->buckets[index].items.size != 0) { 
           if (hash_table->buckets[index].hash_value != hash_value) {
                checked_buckets = 1;
@@ -360,6 +1153,112 @@ uint imh_get_index(List *list, HashTable *hash_table)
      return index;
 }
 
+/**
+ * @brief Computes 2nd-level hash value of lists using open 
+ *        adressing collision resolution and linear probing, claiming
+ *        an empty bucket if needed (see imh_find_index for queries).
+ *
+ * @param list List to be hashed
+ * @param hash_table Hash table structure
+ *
+ * @return Index of the hash table
+ */ 
+uint imh_get_index(List *list, HashTable *hash_table)
+{
+     ullong minhashes[hash_table->tuple_size];
+
+     imh_compute_tuple(list, hash_table, minhashes);
+
+     return imh_get_index_tuple(minhashes, hash_table);
+}
+
+/**
+ * @brief Looks up the bucket holding a minhash tuple without modifying the
+ *        hash table, so it can be called concurrently by several threads.
+ *        Probing stops at the first empty bucket or after checking the
+ *        whole table.
+ *
+ * @param minhashes MinHash values of the tuple
+ * @param hash_table Hash table structure (regular or frozen)
+ *
+ * @return Index of the bucket or IMH_NO_BUCKET if the tuple is not stored
+ */ 
+uint imh_find_index_tuple(ullong *minhashes, const HashTable *hash_table)
+{
+     uint checked_buckets, index, hash_value;
+     
+     imh_hash_tuple(minhashes, hash_table, &hash_value, &index);
+     for (checked_buckets = 0; checked_buckets < hash_table->table_size; checked_buckets++) {
+          if (hash_table->offsets != NULL) {
+               if (hash_table->offsets[index + 1] == hash_table->offsets[index])
+                    return IMH_NO_BUCKET;
+               if (hash_table->keys[index] == hash_value)
+                    return index;
+          } else {
+               if (hash_table->buckets == NULL)
+                    return IMH_NO_BUCKET;
+               if (hash_table->buckets[index].items.size == 0)
+                    return IMH_NO_BUCKET;
+               if (hash_table->buckets[index].hash_value == hash_value)
+                    return index;
+          }
+          index = ((index + 1) & (hash_table->table_size - 1));
+     }
+     
+     return IMH_NO_BUCKET;
+}
+
+/**
+ * @brief Looks up the bucket holding a list without modifying the hash table
+ *
+ * @param list List to be hashed
+ * @param hash_table Hash table structure (regular or frozen)
+ *
+ * @return Index of the bucket or IMH_NO_BUCKET if the list is not stored
+ */ 
+uint imh_find_index(List *list, const HashTable *hash_table)
+{
+     ullong minhashes[hash_table->tuple_size];
+
+     imh_compute_tuple(list, hash_table, minhashes);
+
+     return imh_find_index_tuple(minhashes, hash_table);
+}
+
+/**
+ * @brief Appends the IDs stored in a bucket of a hash table to a list
+ *
+ * @param list List where the IDs will be appended
+ * @param hash_table Hash table structure
+ * @param index Index of the bucket (nothing is appended for IMH_NO_BUCKET)
+ */
+void imh_append_bucket(List *list, const HashTable *hash_table, uint index)
+{
+     if (index == IMH_NO_BUCKET)
+          return;
+
+     if (hash_table->offsets != NULL) {
+          uint i;
+          uint low = hash_table->offsets[index];
+          uint high = hash_table->offsets[index + 1];
+          if (high > low) {
+               list_grow(list, list->size + high - low);
+               for (i = low; i < high; i++) {
+                    list->data[list->size].item = hash_table->ids[i];
+                    list->data[list->size].freq = 1;
+                    list->size++;
+               }
+          }
+     } else {
+          const List *items = &hash_table->buckets[index].items;
+          if (items->size > 0) {
+               list_grow(list, list->size + items->size);
+               memcpy(list->data + list->size, items->data, items->size * sizeof(Item));
+               list->size += items->size;
+          }
+     }
+}
+
 /**
  * @brief Computes the number of sublists for each list in the database
  *
@@ -382,7 +1281,57 @@ uint imh_get_sublist_numbers(ListDB *listdb, uint sublist_size, uint *sublist_nu
 }
 
 /**
- * @brief Generates a database of sublists from a database of lists
+ * @brief Splits a list into random sublists of a given size without
+ *        allocating memory. The items of the list are shuffled with a
+ *        stream of random values and each run of sublist_size consecutive
+ *        items is a sublist; the left items, if any, go to the last one.
+ *        A list smaller than sublist_size has no sublists. The sublists
+ *        point into the given buffer of items and must not be destroyed.
+ *
+ * @param list List to be split
+ * @param sublist_size Size of the sublists
+ * @param rng Stream of random values used for the shuffle
+ * @param items Buffer with room for all the items of the list
+ * @param sublists Buffer with room for list->size / sublist_size sublists
+ *
+ * @return Number of sublists
+ */
+uint imh_split_list(List *list, uint sublist_size, RandomStream *rng, Item *items,
+                    List *sublists)
+{
+     uint i, j;
+     uint number_of_sublists = list->size / sublist_size;
+     ullong int_rnd[IMH_RNG_BLOCK];
+
+     if (number_of_sublists == 0)
+          return 0;
+
+     // Fisher-Yates shuffle, drawing the random values in blocks
+     memcpy(items, list->data, list->size * sizeof(Item));
+     for (i = list->size; i > 1; i--) {
+          uint step = list->size - i;
+          if (step % IMH_RNG_BLOCK == 0)
+               imhrng_fill(rng, int_rnd, min(IMH_RNG_BLOCK, i - 1));
+          j = (uint) (((int_rnd[step % IMH_RNG_BLOCK] >> 32) * i) >> 32);
+          Item tmp = items[i - 1];
+          items[i - 1] = items[j];
+          items[j] = tmp;
+     }
+
+     for (i = 0; i < number_of_sublists; i++) {
+          sublists[i].size = sublist_size;
+          sublists[i].capacity = 0; // views into items, not owned
+          sublists[i].data = items + i * sublist_size;
+     }
+     sublists[number_of_sublists - 1].size += list->size % sublist_size;
+
+     return number_of_sublists;
+}
+
+/**
+ * @brief Generates a database of sublists from a database of lists.
+ *        The sublists of list i are the ones given by imh_split_list with
+ *        stream i of a seed drawn from the global stream.
  *
  * @param sublist_number Number of sublist for each list in the database
  * @param sublistdb_size Total number of sublists
@@ -397,46 +1346,31 @@ ListDB imh_create_sublistdb_from_listdb(ListDB *listdb,
                                         uint sublist_size,
                                         uint *sublistdb_ids)
 {
-     uint i, j, k;
+     uint i, j;
      uint sublist_index = 0;
+     ullong seed = imhrng_next(imhrng_global());
+     RandomStream rng;
 
      ListDB sublistdb = listdb_create(sublistdb_size, listdb->dim);
           
      // creates a database of sublists from a given database of lists
      for (i = 0; i < listdb->size; i++) {
-          // Randomly permutes the list to create the sublists
-          RandomValue *permutation = (RandomValue *) malloc(listdb->lists[i].size
-                                                            * sizeof(RandomValue));
-          for (j = 0; j < listdb->lists[i].size; j++) {
-               permutation[j].random_int = j;
-               permutation[j].random_double = genrand64_real1();
-          }
-          qsort(permutation,
-                listdb->lists[i].size,
-                sizeof(RandomValue),
-                imh_random_double_value_compare_back);
+          Item *items = (Item *) malloc(listdb->lists[i].size * sizeof(Item));
+          List *sublists = (List *) malloc((sublist_number[i] + 1) * sizeof(List));
+          imhrng_init(&rng, seed, i);
+          uint number_of_sublists = imh_split_list(&listdb->lists[i], sublist_size, &rng,
+                                                   items, sublists);
           
-          // create database of sublists
-          for (j = 0; j < sublist_number[i]; j++) {
-               List newsublist;
-               list_init(&newsublist);
-               for (k = sublist_size * j; k < sublist_size * (j + 1); k++) {
-                    list_push(&newsublist,
-                              listdb->lists[i].data[permutation[k].random_int]);
-               }
-
-               sublistdb.lists[sublist_index] = newsublist;
+          for (j = 0; j < number_of_sublists; j++) {
+               sublistdb.lists[sublist_index] = list_create(sublists[j].size);
+               memcpy(sublistdb.lists[sublist_index].data, sublists[j].data,
+                      sublists[j].size * sizeof(Item));
                sublistdb_ids[sublist_index] = i;
                sublist_index++;
           }
 
-          // the last sublist takes the left elements, if any
-          for (j = sublist_size * sublist_number[i]; j < listdb->lists[i].size; j++) {
-                    list_push(&sublistdb.lists[sublist_index - 1],
-                              listdb->lists[i].data[permutation[k].random_int]);
-          }
-          
-          free(permutation);
+          free(sublists);
+          free(items);
      }
      
      listdb_apply_to_all(&sublistdb, list_sort_by_item);
@@ -445,18 +1379,27 @@ ListDB imh_create_sublistdb_from_listdb(ListDB *listdb,
 }
 
 /**
- * @brief Stores lists in the hash table.
+ * @brief Stores the ID of a list in the hash table given its minhash tuple.
  *
- * @param list List to be hashed
+ * @param minhashes MinHash values of the tuple of the list
  * @param id ID of the list
  * @param hash_table Hash table
  */ 
-void imh_store_list(List *list, uint id, HashTable *hash_table)
+void imh_store_tuple(ullong *minhashes, uint id, HashTable *hash_table)
 {
      uint index;
+
+     if (hash_table->keys != NULL) {
+          fprintf(stderr,"Error: Lists cannot be stored in a frozen hash table!\n");
+          exit(EXIT_FAILURE);
+     }
+
+     // the buckets are only allocated for tables that store lists
+     if (hash_table->buckets == NULL)
+          hash_table->buckets = (Bucket *) calloc(hash_table->table_size, sizeof(Bucket));
    
      // get index of the hash table
-     index = imh_get_index(list, hash_table);
+     index = imh_get_index_tuple(minhashes, hash_table);
 
      if (hash_table->buckets[index].items.size == 0) { // mark used bucket
           Item new_used_bucket = {index, 1};
@@ -468,6 +1411,21 @@ void imh_store_list(List *list, uint id, HashTable *hash_table)
      list_push(&hash_table->buckets[index].items, new_item);
 }
 
+/**
+ * @brief Stores lists in the hash table.
+ *
+ * @param list List to be hashed
+ * @param id ID of the list
+ * @param hash_table Hash table
+ */ 
+void imh_store_list(List *list, uint id, HashTable *hash_table)
+{
+     ullong minhashes[hash_table->tuple_size];
+
+     imh_compute_tuple(list, hash_table, minhashes);
+     imh_store_tuple(minhashes, id, hash_table);
+}
+
 /**
  * @brief Stores a database of sublists in the hash table.
  *
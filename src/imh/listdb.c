@@ -22,6 +22,13 @@
 #include <string.h>
 #include <inttypes.h>
 #include <float.h>
+#include <limits.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "listdb.h"
 
 /**
@@ -34,6 +41,11 @@ void listdb_init(ListDB *listdb)
      listdb->size = 0;
      listdb->dim = 0;
      listdb->lists = NULL;
+     listdb->number_of_items = 0;
+     listdb->arena = NULL;
+     listdb->item_column = NULL;
+     listdb->mapping = NULL;
+     listdb->mapping_size = 0;
 }
 
 /**
@@ -46,6 +58,7 @@ void listdb_init(ListDB *listdb)
 ListDB listdb_create(uint size, uint dim)
 {     
      ListDB listdb;
+     listdb_init(&listdb);
      listdb.size = size;
      listdb.dim = dim;
      listdb.lists = (List *) calloc(size, sizeof(List));
@@ -75,13 +88,32 @@ ListDB listdb_random(uint dbsize, uint max_size, uint max_item)
 }
 
 /**
- * @brief Clears a list database structure
+ * @brief Frees the arena of a list database or unmaps the file that holds it
+ *
+ * @param *listdb List database
+ */
+static void listdb_free_arena(ListDB *listdb)
+{
+     if (listdb->mapping != NULL)
+          munmap(listdb->mapping, listdb->mapping_size);
+     else
+          free(listdb->arena);
+     listdb->mapping = NULL;
+     listdb->mapping_size = 0;
+     listdb->arena = NULL;
+}
+
+/**
+ * @brief Clears a list database structure. The items of the lists that own
+ *        them are not freed, the arena is.
  *
  * @param *listdb List database to be cleared
  */
 void listdb_clear(ListDB *listdb)
 {     
      free(listdb->lists);
+     listdb_free_arena(listdb);
+     free(listdb->item_column);
      listdb_init(listdb);
 }
 
@@ -94,11 +126,99 @@ void listdb_destroy(ListDB *listdb)
 {     
      int i;
 
+     // lists in the arena do not own their items and are freed all at once
      for (i = 0; i < listdb->size; i++)
           list_destroy(&listdb->lists[i]);
 
-     free(listdb->lists);
-     listdb_init(listdb);
+     listdb_clear(listdb);
+}
+
+/**
+ * @brief Moves the items of all the lists of a database into a single arena.
+ *        The lists become views into the arena (capacity zero) and are
+ *        stored one after the other in the order of the database.
+ *
+ * @param *listdb List database to be packed
+ */
+void listdb_pack(ListDB *listdb)
+{
+     uint i;
+     ullong number_of_items = 0;
+
+     for (i = 0; i < listdb->size; i++)
+          number_of_items += listdb->lists[i].size;
+
+     Item *arena = (Item *) malloc((number_of_items > 0 ? number_of_items : 1) * sizeof(Item));
+     if (!arena) {
+          fprintf(stderr,"Error: Could not allocate an arena of %llu items\n", number_of_items);
+          exit(EXIT_FAILURE);
+     }
+
+     ullong offset = 0;
+     for (i = 0; i < listdb->size; i++) {
+          uint size = listdb->lists[i].size;
+          memcpy(arena + offset, listdb->lists[i].data, size * sizeof(Item));
+          list_destroy(&listdb->lists[i]);
+          listdb->lists[i].size = size;
+          listdb->lists[i].data = arena + offset;
+          offset += size;
+     }
+
+     listdb_free_arena(listdb);
+     free(listdb->item_column);
+     listdb->item_column = NULL;
+     listdb->arena = arena;
+     listdb->number_of_items = number_of_items;
+}
+
+/**
+ * @brief Splits the items of the arena of a database into a column of items
+ *        without their frequencies, so that set-only computations (e.g.
+ *        overlap or Jaccard) stream only the items. The frequencies stay in
+ *        the arena. The database is packed first if needed. The column is a
+ *        copy (4 more bytes per item) and must be split again if the lists
+ *        in the arena are modified. For a mapped database (see
+ *        listdb_load_from_binary_file) it copies every item out of the
+ *        shared pages of the file.
+ *
+ * @param *listdb List database
+ */
+void listdb_split_columns(ListDB *listdb)
+{
+     ullong i;
+
+     if (listdb->arena == NULL)
+          listdb_pack(listdb);
+
+     free(listdb->item_column);
+     listdb->item_column = (uint *) malloc((listdb->number_of_items + 1) * sizeof(uint));
+     if (!listdb->item_column) {
+          fprintf(stderr,"Error: Could not allocate the column of %llu items\n",
+                  listdb->number_of_items);
+          exit(EXIT_FAILURE);
+     }
+
+     for (i = 0; i < listdb->number_of_items; i++)
+          listdb->item_column[i] = listdb->arena[i].item;
+}
+
+/**
+ * @brief Gets the items of a list from the column of items of a database
+ *
+ * @param *listdb List database with split columns
+ * @param index Position of the list in the database
+ *
+ * @return Items of the list or NULL if the list is not in the columns
+ */
+const uint *listdb_item_column(ListDB *listdb, uint index)
+{
+     List *list = &listdb->lists[index];
+
+     if (listdb->item_column != NULL && list->capacity == 0 && list->data != NULL
+         && list->data >= listdb->arena && list->data < listdb->arena + listdb->number_of_items)
+          return listdb->item_column + (list->data - listdb->arena);
+
+     return NULL;
 }
 
 /**
@@ -223,13 +343,15 @@ void listdb_sort_by_size_back(ListDB *listdb)
  */
 Score *listdb_compute_scores(ListDB *listdb, double (*func)(List *))
 {
-     Score *scores = malloc(listdb->size);
+     Score *scores = (Score *) malloc(listdb->size * sizeof(Score));
      
      uint i;
      for (i = 0; i < listdb->size; i++) {
           scores[i].index = i;
           scores[i].value = func(&listdb->lists[i]);
      }
+
+     return scores;
 }
 
 /**
@@ -240,14 +362,14 @@ Score *listdb_compute_scores(ListDB *listdb, double (*func)(List *))
  */
 void listdb_swap_by_score(ListDB *listdb, Score *scores)
 {
-     ListDB newlistdb = listdb_create(listdb->size, listdb->dim);
+     List *lists = (List *) malloc(listdb->size * sizeof(List));
      
      uint i;
      for (i = 0; i < listdb->size; i++) 
-          newlistdb.lists[i] = listdb->lists[scores[i].index];
+          lists[i] = listdb->lists[scores[i].index];
      
-     listdb_clear(listdb);
-     *listdb = newlistdb;
+     free(listdb->lists);
+     listdb->lists = lists;
 }
 
 /**
@@ -260,6 +382,7 @@ void listdb_sort_by_score(ListDB *listdb, double (*func)(List *))
      Score *scores = listdb_compute_scores(listdb, func);
      qsort(scores, listdb->size, sizeof(Score), list_score_compare);	
      listdb_swap_by_score(listdb, scores);
+     free(scores);
 }
 
 /**
@@ -272,6 +395,7 @@ void listdb_sort_by_score_back(ListDB *listdb, double (*func)(List *))
      Score *scores = listdb_compute_scores(listdb, func);
      qsort(scores, listdb->size, sizeof(Score), list_score_compare_back);	
      listdb_swap_by_score(listdb, scores);
+     free(scores);
 }
 
 /**
@@ -557,7 +681,319 @@ void listdb_add_lists_destroy(ListDB *listdb, uint position1, uint position2)
 }
 
 /**
- * @brief Loads a list database from a file
+ * @brief Lists parsed so far, stored as in an arena but with room to grow
+ */
+typedef struct ListParser{
+     ListDB listdb;
+     uint lists_capacity;
+     ullong items_capacity;
+     char error[128]; // description of the first malformed line
+}ListParser;
+
+/**
+ * @brief Initializes a parser of lists
+ *
+ * @param *parser Parser to initialize
+ */
+static void listdb_parser_init(ListParser *parser)
+{
+     listdb_init(&parser->listdb);
+     parser->lists_capacity = 0;
+     parser->items_capacity = 0;
+     parser->error[0] = '\0';
+}
+
+/**
+ * @brief Records the error of a malformed line in a parser
+ *
+ * @param *parser Parser
+ * @param message Description of the error
+ * @param c Offending character
+ *
+ * @return NULL, so that parsing stops
+ */
+static const char *listdb_parse_error(ListParser *parser, const char *message, char c)
+{
+     if (c == '\n')
+          snprintf(parser->error, sizeof(parser->error), "%s, found end of line", message);
+     else if (c >= ' ' && c <= '~')
+          snprintf(parser->error, sizeof(parser->error), "%s, found '%c'", message, c);
+     else
+          snprintf(parser->error, sizeof(parser->error), "%s, found byte 0x%02x", message,
+                   (unsigned char) c);
+
+     return NULL;
+}
+
+/**
+ * @brief Records the error of a number that could not be scanned in a parser
+ *
+ * @param *parser Parser
+ * @param message Description of what was expected
+ * @param begin Position where the number was expected
+ *
+ * @return NULL, so that parsing stops
+ */
+static const char *listdb_scan_error(ListParser *parser, const char *message, const char *begin)
+{
+     if ((uint) (*begin - '0') < 10) {
+          snprintf(parser->error, sizeof(parser->error), "number larger than %u", UINT_MAX);
+          return NULL;
+     }
+
+     return listdb_parse_error(parser, message, *begin);
+}
+
+/**
+ * @brief Scans an unsigned integer in decimal notation
+ *
+ * @param p Position where the integer starts
+ * @param value Scanned integer
+ *
+ * @return Position after the integer or NULL if there is no integer or it
+ *         does not fit in an uint
+ */
+static inline const char *listdb_scan_uint(const char *p, uint *value)
+{
+     const char *start = p;
+     ullong v = 0;
+
+     while ((uint) (*p - '0') < 10) {
+          v = v * 10 + (uint) (*p - '0');
+          if (v > UINT_MAX)
+               return NULL;
+          p++;
+     }
+     *value = (uint) v;
+
+     return p == start ? NULL : p;
+}
+
+/**
+ * @brief Parses complete lines of lists (format of listdb_load_from_file)
+ *        appending them to a parser. The last line must end with a newline.
+ *
+ * @param *parser Parser where the lists are appended
+ * @param begin First byte to parse
+ * @param end End of the bytes to parse (right after a newline)
+ * @param max_lists Maximum number of lists in the parser
+ * @param *line Line number of the first byte, updated with the lines parsed
+ *
+ * @return Position after the last parsed line or NULL if a line is malformed
+ *         (line is then its number and the error is described in the parser)
+ */
+static const char *listdb_parse(ListParser *parser, const char *begin, const char *end,
+                                uint max_lists, ullong *line)
+{
+     const char *p = begin;
+     ListDB *listdb = &parser->listdb;
+
+     while (p < end && listdb->size < max_lists) {
+          uint j, size;
+          while (*p == ' ' || *p == '\t' || *p == '\r')
+               p++;
+          if (*p == '\n') { // empty lines are skipped
+               p++;
+               (*line)++;
+               continue;
+          }
+
+          if (!(p = listdb_scan_uint(begin = p, &size)))
+               return listdb_scan_error(parser, "expected the size of a list", begin);
+
+          if (listdb->size == parser->lists_capacity) {
+               parser->lists_capacity = parser->lists_capacity < 1024 ? 1024 : 2 * parser->lists_capacity;
+               listdb->lists = (List *) realloc(listdb->lists, parser->lists_capacity * sizeof(List));
+          }
+          if (listdb->number_of_items + size > parser->items_capacity) {
+               parser->items_capacity = max(2 * parser->items_capacity,
+                                            listdb->number_of_items + size + 1024);
+               listdb->arena = (Item *) realloc(listdb->arena, parser->items_capacity * sizeof(Item));
+          }
+          if (!listdb->lists || !listdb->arena) {
+               fprintf(stderr,"Error: Could not allocate %llu items\n", parser->items_capacity);
+               exit(EXIT_FAILURE);
+          }
+
+          Item *items = listdb->arena + listdb->number_of_items;
+          for (j = 0; j < size; j++) {
+               if (*p == '\n' || *p == '\r')
+                    return listdb_parse_error(parser, "fewer items than the size of the list", *p);
+               if (*p != ' ' && *p != '\t')
+                    return listdb_parse_error(parser, j == 0 ? "expected a blank after the size"
+                                              : "expected a blank after an item", *p);
+               while (*p == ' ' || *p == '\t')
+                    p++;
+               if (!(p = listdb_scan_uint(begin = p, &items[j].item)))
+                    return listdb_scan_error(parser, "expected an item", begin);
+               if (*p != ':')
+                    return listdb_parse_error(parser, "expected ':' after an item", *p);
+               if (!(p = listdb_scan_uint(begin = p + 1, &items[j].freq)))
+                    return listdb_scan_error(parser, "expected a frequency", begin);
+               if (listdb->dim < items[j].item + 1)
+                    listdb->dim = items[j].item + 1;
+          }
+
+          while (*p == ' ' || *p == '\t' || *p == '\r')
+               p++;
+          if (*p != '\n')
+               return listdb_parse_error(parser, "more items than the size of the list", *p);
+          p++;
+          (*line)++;
+
+          // pointers are set when the arena no longer moves
+          listdb->lists[listdb->size].size = size;
+          listdb->lists[listdb->size].capacity = 0;
+          listdb->lists[listdb->size].data = NULL;
+          listdb->number_of_items += size;
+          listdb->size++;
+     }
+
+     return p;
+}
+
+/**
+ * @brief Trims the storage of a parser and points its lists into the arena
+ *
+ * @param *parser Parser with the lists
+ *
+ * @return List database with the parsed lists
+ */
+static ListDB listdb_parser_finish(ListParser *parser)
+{
+     uint i;
+     ListDB listdb = parser->listdb;
+     ullong offset = 0;
+
+     listdb.lists = (List *) realloc(listdb.lists, (listdb.size > 0 ? listdb.size : 1) * sizeof(List));
+     listdb.arena = (Item *) realloc(listdb.arena, (listdb.number_of_items > 0 ? listdb.number_of_items : 1)
+                                     * sizeof(Item));
+     for (i = 0; i < listdb.size; i++) {
+          listdb.lists[i].data = listdb.arena + offset;
+          offset += listdb.lists[i].size;
+     }
+
+     return listdb;
+}
+
+/**
+ * @brief Starts reading lists from a file (it can be stdin). The file is
+ *        read through its descriptor, so nothing must have been read from
+ *        it through its stream buffer.
+ *
+ * @param *reader Reader to start
+ * @param file File opened for reading
+ * @param name Name of the file in error messages
+ */
+void listdb_reader_open(ListReader *reader, FILE *file, const char *name)
+{
+     reader->file = file;
+     reader->name = name;
+     reader->capacity = LISTDB_BLOCK_SIZE;
+     reader->buffer = (char *) malloc(reader->capacity);
+     reader->begin = 0;
+     reader->end = 0;
+     reader->line = 1;
+     reader->eof = 0;
+     if (!reader->buffer) {
+          fprintf(stderr,"Error: Could not allocate a buffer to read %s\n", name);
+          exit(EXIT_FAILURE);
+     }
+}
+
+/**
+ * @brief Frees the buffer of a reader (the file is not closed)
+ *
+ * @param *reader Reader to close
+ */
+void listdb_reader_close(ListReader *reader)
+{
+     free(reader->buffer);
+     reader->buffer = NULL;
+}
+
+/**
+ * @brief Reads the next block of a file, keeping the bytes not parsed yet.
+ *        The buffer grows when a single line does not fit in it.
+ *
+ * @param *reader Reader
+ */
+static void listdb_reader_fill(ListReader *reader)
+{
+     memmove(reader->buffer, reader->buffer + reader->begin, reader->end - reader->begin);
+     reader->end -= reader->begin;
+     reader->begin = 0;
+     if (reader->capacity - reader->end < LISTDB_BLOCK_SIZE / 2) {
+          reader->capacity *= 2;
+          reader->buffer = (char *) realloc(reader->buffer, reader->capacity);
+          if (!reader->buffer) {
+               fprintf(stderr,"Error: Could not allocate a buffer to read %s\n", reader->name);
+               exit(EXIT_FAILURE);
+          }
+     }
+
+     // one byte is kept for the newline added at the end of the file. The
+     // descriptor is read directly, so whatever a pipe already holds is
+     // parsed without waiting for a full block
+     ssize_t bytes;
+     do {
+          bytes = read(fileno(reader->file), reader->buffer + reader->end,
+                       reader->capacity - reader->end - 1);
+     } while (bytes < 0 && errno == EINTR);
+     if (bytes < 0) {
+          fprintf(stderr,"Error: Could not read %s\n", reader->name);
+          exit(EXIT_FAILURE);
+     }
+     if (bytes == 0)
+          reader->eof = 1;
+     reader->end += bytes;
+}
+
+/**
+ * @brief Reads lists from a reader (format of listdb_load_from_file) into
+ *        a database stored in an arena. Malformed lines are reported with
+ *        their line number.
+ *
+ * @param *reader Reader
+ * @param max_lists Maximum number of lists to read
+ *
+ * @return List database with the lists read (empty at the end of the file)
+ */
+ListDB listdb_read(ListReader *reader, uint max_lists)
+{
+     ListParser parser;
+     listdb_parser_init(&parser);
+
+     while (parser.listdb.size < max_lists) {
+          // only complete lines are parsed
+          size_t last = reader->end;
+          while (last > reader->begin && reader->buffer[last - 1] != '\n')
+               last--;
+
+          if (last > reader->begin) {
+               const char *p = listdb_parse(&parser, reader->buffer + reader->begin,
+                                            reader->buffer + last, max_lists, &reader->line);
+               if (!p) {
+                    fprintf(stderr,"Error: %s:%llu: %s\n", reader->name, reader->line, parser.error);
+                    exit(EXIT_FAILURE);
+               }
+               reader->begin = p - reader->buffer;
+          } else if (!reader->eof) {
+               listdb_reader_fill(reader);
+          } else if (reader->begin < reader->end) {
+               reader->buffer[reader->end++] = '\n';
+          } else {
+               break;
+          }
+     }
+
+     return listdb_parser_finish(&parser);
+}
+
+/**
+ * @brief Loads a list database from a file. The file is read in blocks and
+ *        the lists are stored in an arena. Binary files (see
+ *        listdb_save_to_binary_file) are mapped instead.
  *        Format: 
  *             size item_1:freq_1 item_2:freq_2 ... item_size:freq_size
  *                        ...
@@ -568,39 +1004,19 @@ void listdb_add_lists_destroy(ListDB *listdb, uint position1, uint position2)
  */
 ListDB listdb_load_from_file(char *filename)
 {
+     if (listdb_is_binary_file(filename))
+          return listdb_load_from_binary_file(filename);
+
      FILE *file;
      if (!(file = fopen(filename,"r"))) {
           fprintf(stderr,"Error: Could not open file %s\n", filename);
           exit(EXIT_FAILURE);
      }
 
-     // checking the number of lists in the file
-     size_t len = 0;
-     ssize_t read;
-     char *line = NULL;
-     ListDB listdb;
-     listdb.size = 0;
-     while ((read = getline(&line, &len, file)) != -1) {
-          if ('\n' != line[0])
-               listdb.size++;
-     }
-     rewind(file);
-
-     // reading lists
-     listdb.dim = 0;
-     listdb.lists = (List *) malloc(listdb.size * sizeof(List));
-
-     uint i, j;
-     for (i = 0; i < listdb.size; i ++) {
-          fscanf(file,"%u", &listdb.lists[i].size);
-          listdb.lists[i].data = (Item *) malloc(listdb.lists[i].size * sizeof(Item));
-          for (j = 0; j < listdb.lists[i].size; j++) {
-               char sep;
-               fscanf(file,"%u%c%u", &listdb.lists[i].data[j].item, &sep, &listdb.lists[i].data[j].freq);
-               if (listdb.dim < listdb.lists[i].data[j].item + 1)
-                    listdb.dim = listdb.lists[i].data[j].item + 1;
-          }
-     }
+     ListReader reader;
+     listdb_reader_open(&reader, file, filename);
+     ListDB listdb = listdb_read(&reader, UINT_MAX);
+     listdb_reader_close(&reader);
      
      if (fclose(file)) {
           fprintf(stderr,"Error: Could not close file %s\n", filename);
@@ -610,6 +1026,207 @@ ListDB listdb_load_from_file(char *filename)
      return listdb;
 }
 
+/**
+ * @brief Work of a single thread of a parallel load: a chunk of complete
+ *        lines of the file and the lists parsed from it
+ */
+typedef struct LoadTask {
+     const char *begin;
+     const char *end;
+     ullong number_of_lines; // lines parsed (the malformed one if any)
+     ListParser parser;
+     const char *parsed; // NULL if a line is malformed
+     ListDB *listdb; // database where the lists of all the chunks are stitched
+     uint first_list;
+     ullong first_item;
+} LoadTask;
+
+/**
+ * @brief Parses the chunk of a parallel load
+ *
+ * @param arg Task of the thread
+ */
+static void *listdb_parse_worker(void *arg)
+{
+     LoadTask *task = (LoadTask *) arg;
+
+     task->parsed = task->begin;
+     if (task->begin < task->end)
+          task->parsed = listdb_parse(&task->parser, task->begin, task->end, UINT_MAX,
+                                      &task->number_of_lines);
+
+     return NULL;
+}
+
+/**
+ * @brief Copies the lists parsed from a chunk into their place in the database
+ *
+ * @param arg Task of the thread
+ */
+static void *listdb_stitch_worker(void *arg)
+{
+     LoadTask *task = (LoadTask *) arg;
+     ListDB *chunk = &task->parser.listdb;
+     Item *items = task->listdb->arena + task->first_item;
+     uint i;
+
+     memcpy(items, chunk->arena, chunk->number_of_items * sizeof(Item));
+     for (i = 0; i < chunk->size; i++) {
+          task->listdb->lists[task->first_list + i].size = chunk->lists[i].size;
+          task->listdb->lists[task->first_list + i].capacity = 0;
+          task->listdb->lists[task->first_list + i].data = items;
+          items += chunk->lists[i].size;
+     }
+     free(chunk->lists);
+     free(chunk->arena);
+
+     return NULL;
+}
+
+/**
+ * @brief Runs one task per thread
+ *
+ * @param worker Function run by each thread
+ * @param tasks Tasks
+ * @param number_of_tasks Number of tasks
+ */
+static void listdb_run_tasks(void *(*worker)(void *), LoadTask *tasks, uint number_of_tasks)
+{
+     uint i;
+     pthread_t *threads = (pthread_t *) malloc(number_of_tasks * sizeof(pthread_t));
+
+     for (i = 1; i < number_of_tasks; i++) {
+          if (pthread_create(&threads[i], NULL, worker, &tasks[i]) != 0) {
+               fprintf(stderr,"Error: Could not create load thread %u\n", i);
+               exit(EXIT_FAILURE);
+          }
+     }
+     worker(&tasks[0]);
+     for (i = 1; i < number_of_tasks; i++)
+          pthread_join(threads[i], NULL);
+
+     free(threads);
+}
+
+/**
+ * @brief Loads a list database from a file using several threads. The file
+ *        is mapped in memory and split at line boundaries into one chunk per
+ *        thread. The chunks are parsed at the same time and stitched in order
+ *        into a single arena, so the database is the same as the one given by
+ *        listdb_load_from_file. Small files and files that cannot be mapped
+ *        (e.g. pipes) are loaded by a single thread.
+ *
+ * @param filename File containing the inverted file index of lists
+ * @param number_of_threads Number of threads (0 uses all online processors)
+ *
+ * @return List database
+ */
+ListDB listdb_load_from_file_parallel(char *filename, uint number_of_threads)
+{
+     uint i;
+     int fd;
+     struct stat info;
+
+     if (listdb_is_binary_file(filename))
+          return listdb_load_from_binary_file(filename);
+
+     if (number_of_threads == 0) {
+          long online = sysconf(_SC_NPROCESSORS_ONLN);
+          number_of_threads = online > 0 ? (uint) online : 1;
+     }
+
+     if ((fd = open(filename, O_RDONLY)) < 0) {
+          fprintf(stderr,"Error: Could not open file %s\n", filename);
+          exit(EXIT_FAILURE);
+     }
+     if (fstat(fd, &info) != 0) {
+          close(fd);
+          return listdb_load_from_file(filename);
+     }
+
+     // chunks smaller than a block are not worth a thread
+     if (number_of_threads > info.st_size / LISTDB_BLOCK_SIZE + 1)
+          number_of_threads = info.st_size / LISTDB_BLOCK_SIZE + 1;
+
+     const char *text = MAP_FAILED;
+     size_t size = (size_t) info.st_size;
+     if (number_of_threads > 1 && S_ISREG(info.st_mode))
+          text = (const char *) mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+     close(fd);
+     if (text == MAP_FAILED)
+          return listdb_load_from_file(filename);
+
+     // a last line without newline is parsed from a copy that has one
+     const char *tail = text + size;
+     while (tail > text && tail[-1] != '\n')
+          tail--;
+     size_t tail_size = (size_t) (text + size - tail);
+     char *last_line = (char *) malloc(tail_size + 1);
+     memcpy(last_line, tail, tail_size);
+     last_line[tail_size] = '\n';
+
+     uint number_of_tasks = number_of_threads + (tail_size > 0);
+     LoadTask *tasks = (LoadTask *) calloc(number_of_tasks, sizeof(LoadTask));
+     const char *begin = text;
+     for (i = 0; i < number_of_threads; i++) {
+          const char *end = text + (ullong) (i + 1) * (tail - text) / number_of_threads;
+          if (end < begin)
+               end = begin;
+          if (end > begin && end[-1] != '\n') {
+               end = (const char *) memchr(end, '\n', tail - end);
+               end = end ? end + 1 : tail;
+          }
+          tasks[i].begin = begin;
+          tasks[i].end = end;
+          begin = end;
+     }
+     if (tail_size > 0) {
+          tasks[number_of_threads].begin = last_line;
+          tasks[number_of_threads].end = last_line + tail_size + 1;
+     }
+     for (i = 0; i < number_of_tasks; i++)
+          listdb_parser_init(&tasks[i].parser);
+
+     listdb_run_tasks(listdb_parse_worker, tasks, number_of_tasks);
+
+     // line numbers are known once the chunks before a malformed line are parsed
+     ullong line = 1;
+     for (i = 0; i < number_of_tasks; i++) {
+          if (!tasks[i].parsed) {
+               fprintf(stderr,"Error: %s:%llu: %s\n", filename, line + tasks[i].number_of_lines,
+                       tasks[i].parser.error);
+               exit(EXIT_FAILURE);
+          }
+          line += tasks[i].number_of_lines;
+     }
+     munmap((void *) text, size);
+     free(last_line);
+
+     ListDB listdb;
+     listdb_init(&listdb);
+     for (i = 0; i < number_of_tasks; i++) {
+          tasks[i].listdb = &listdb;
+          tasks[i].first_list = listdb.size;
+          tasks[i].first_item = listdb.number_of_items;
+          listdb.size += tasks[i].parser.listdb.size;
+          listdb.number_of_items += tasks[i].parser.listdb.number_of_items;
+          if (listdb.dim < tasks[i].parser.listdb.dim)
+               listdb.dim = tasks[i].parser.listdb.dim;
+     }
+     listdb.lists = (List *) malloc((listdb.size > 0 ? listdb.size : 1) * sizeof(List));
+     listdb.arena = (Item *) malloc((listdb.number_of_items > 0 ? listdb.number_of_items : 1)
+                                    * sizeof(Item));
+     if (!listdb.lists || !listdb.arena) {
+          fprintf(stderr,"Error: Could not allocate %llu items\n", listdb.number_of_items);
+          exit(EXIT_FAILURE);
+     }
+
+     listdb_run_tasks(listdb_stitch_worker, tasks, number_of_tasks);
+     free(tasks);
+
+     return listdb;
+}
+
 /**
  * @brief Saves a list database in a file.
  *        Format: 
@@ -626,16 +1243,358 @@ void listdb_save_to_file(char *filename, ListDB *listdb)
           exit(EXIT_FAILURE);
      }
 
-     uint i, j;
-     for (i = 0; i < listdb->size; i++) {
-          fprintf(file,"%u", listdb->lists[i].size);
-          for (j = 0; j < listdb->lists[i].size; j++)
-               fprintf(file," %u:%u", listdb->lists[i].data[j].item, listdb->lists[i].data[j].freq);
-          fprintf(file,"\n");
+     uint i;
+     ListWriter writer;
+     listdb_writer_open(&writer, file, filename);
+     for (i = 0; i < listdb->size; i++)
+          listdb_write_list(&writer, &listdb->lists[i]);
+     listdb_writer_close(&writer);
+
+     if (fclose(file)) {
+          fprintf(stderr,"Error: Could not close file %s\n", filename);
+          exit(EXIT_FAILURE);
      }
+}
+
+/**
+ * @brief Saves a list database with a score for each item in a binary
+ *        results file (see listdb_write_results_header and
+ *        listdb_write_scored_list)
+ *
+ * @param filename File where the results will be saved
+ * @param listdb List database to save (e.g. neighbors of each query)
+ * @param scores Scores of the items of each list
+ */
+void listdb_save_scored_to_file(char *filename, ListDB *listdb, double **scores)
+{
+     FILE *file;     
+     if (!(file = fopen(filename,"wb"))) {
+          fprintf(stderr,"Error: Could not create file %s\n", filename);
+          exit(EXIT_FAILURE);
+     }
+
+     uint i;
+     ListWriter writer;
+     listdb_writer_open(&writer, file, filename);
+     listdb_write_results_header(&writer);
+     for (i = 0; i < listdb->size; i++)
+          listdb_write_scored_list(&writer, &listdb->lists[i], scores[i]);
+     listdb_writer_close(&writer);
 
      if (fclose(file)) {
           fprintf(stderr,"Error: Could not close file %s\n", filename);
           exit(EXIT_FAILURE);
      }
 }
+
+/**
+ * @brief Starts writing lists to a file (it can be stdout)
+ *
+ * @param *writer Writer to start
+ * @param file File opened for writing
+ * @param name Name of the file in error messages
+ */
+void listdb_writer_open(ListWriter *writer, FILE *file, const char *name)
+{
+     writer->file = file;
+     writer->name = name;
+     writer->size = 0;
+     writer->buffer = (char *) malloc(LISTDB_WRITE_BUFFER_SIZE);
+     if (!writer->buffer) {
+          fprintf(stderr,"Error: Could not allocate a buffer to write %s\n", name);
+          exit(EXIT_FAILURE);
+     }
+}
+
+/**
+ * @brief Writes the buffer of a writer to its file
+ *
+ * @param *writer Writer
+ */
+void listdb_writer_flush(ListWriter *writer)
+{
+     if (writer->size > 0 && fwrite(writer->buffer, 1, writer->size, writer->file) != writer->size) {
+          fprintf(stderr,"Error: Could not write %s\n", writer->name);
+          exit(EXIT_FAILURE);
+     }
+     writer->size = 0;
+     if (fflush(writer->file)) {
+          fprintf(stderr,"Error: Could not write %s\n", writer->name);
+          exit(EXIT_FAILURE);
+     }
+}
+
+/**
+ * @brief Flushes a writer and frees its buffer (the file is not closed)
+ *
+ * @param *writer Writer to close
+ */
+void listdb_writer_close(ListWriter *writer)
+{
+     listdb_writer_flush(writer);
+     free(writer->buffer);
+     writer->buffer = NULL;
+}
+
+/**
+ * @brief Makes room for a given number of bytes in the buffer of a writer
+ *
+ * @param *writer Writer
+ * @param bytes Number of bytes
+ */
+static inline void listdb_writer_reserve(ListWriter *writer, size_t bytes)
+{
+     if (writer->size + bytes > LISTDB_WRITE_BUFFER_SIZE)
+          listdb_writer_flush(writer);
+}
+
+/**
+ * @brief Formats an unsigned integer in decimal notation, two digits at a time
+ *
+ * @param out Where the digits are written (at least 10 bytes)
+ * @param value Integer to format
+ *
+ * @return Number of digits
+ */
+static inline uint listdb_format_uint(char *out, uint value)
+{
+     static const char pairs[201] =
+          "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+          "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+          "8081828384858687888990919293949596979899";
+     char digits[10];
+     char *p = digits + 10;
+
+     while (value >= 100) {
+          uint pair = (value % 100) * 2;
+          value /= 100;
+          *--p = pairs[pair + 1];
+          *--p = pairs[pair];
+     }
+     if (value >= 10) {
+          *--p = pairs[value * 2 + 1];
+          *--p = pairs[value * 2];
+     } else {
+          *--p = (char) ('0' + value);
+     }
+
+     uint length = (uint) (digits + 10 - p);
+     memcpy(out, p, length);
+
+     return length;
+}
+
+/**
+ * @brief Writes a list in the text format of listdb_save_to_file
+ *
+ * @param *writer Writer
+ * @param list List to write
+ */
+void listdb_write_list(ListWriter *writer, List *list)
+{
+     uint j;
+
+     listdb_writer_reserve(writer, 11);
+     writer->size += listdb_format_uint(writer->buffer + writer->size, list->size);
+     for (j = 0; j < list->size; j++) {
+          listdb_writer_reserve(writer, 23);
+          char *out = writer->buffer + writer->size;
+          *out++ = ' ';
+          out += listdb_format_uint(out, list->data[j].item);
+          *out++ = ':';
+          out += listdb_format_uint(out, list->data[j].freq);
+          writer->size = out - writer->buffer;
+     }
+     listdb_writer_reserve(writer, 1);
+     writer->buffer[writer->size++] = '\n';
+}
+
+/**
+ * @brief Writes the header of a binary results file: its magic and version
+ *        (two uint values)
+ *
+ * @param *writer Writer
+ */
+void listdb_write_results_header(ListWriter *writer)
+{
+     uint version = LISTDB_RESULTS_VERSION;
+
+     listdb_writer_reserve(writer, sizeof(LISTDB_RESULTS_MAGIC) - 1 + sizeof(uint));
+     memcpy(writer->buffer + writer->size, LISTDB_RESULTS_MAGIC, sizeof(LISTDB_RESULTS_MAGIC) - 1);
+     writer->size += sizeof(LISTDB_RESULTS_MAGIC) - 1;
+     memcpy(writer->buffer + writer->size, &version, sizeof(uint));
+     writer->size += sizeof(uint);
+}
+
+/**
+ * @brief Writes a list with the score of each item in the binary results
+ *        format (native byte order): the size of the list (uint) followed
+ *        by one ScoredItem per item
+ *
+ * @param *writer Writer
+ * @param list List to write
+ * @param scores Score of each item of the list
+ */
+void listdb_write_scored_list(ListWriter *writer, List *list, double *scores)
+{
+     uint j;
+
+     listdb_writer_reserve(writer, sizeof(uint));
+     memcpy(writer->buffer + writer->size, &list->size, sizeof(uint));
+     writer->size += sizeof(uint);
+     for (j = 0; j < list->size; j++) {
+          ScoredItem record = {list->data[j].item, (float) scores[j]};
+          listdb_writer_reserve(writer, sizeof(ScoredItem));
+          memcpy(writer->buffer + writer->size, &record, sizeof(ScoredItem));
+          writer->size += sizeof(ScoredItem);
+     }
+}
+
+/**
+ * @brief Checks whether a file is a binary list database file. Only regular
+ *        files are checked, so pipes are not consumed.
+ *
+ * @param filename File name
+ *
+ * @return 1 if the file starts with the magic of binary files, 0 otherwise
+ */
+int listdb_is_binary_file(char *filename)
+{
+     int fd;
+     struct stat info;
+     char magic[sizeof(LISTDB_MAGIC) - 1];
+     int binary = 0;
+
+     if ((fd = open(filename, O_RDONLY)) < 0)
+          return 0;
+     if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)
+         && read(fd, magic, sizeof(magic)) == sizeof(magic))
+          binary = memcmp(magic, LISTDB_MAGIC, sizeof(magic)) == 0;
+     close(fd);
+
+     return binary;
+}
+
+/**
+ * @brief Loads a binary list database file without copying its items. The
+ *        file is mapped in memory (copy-on-write, so the lists can be modified
+ *        without changing the file) and the lists are views into it, so
+ *        processes that load the same file share its pages.
+ *
+ * @param filename File written by listdb_save_to_binary_file
+ *
+ * @return List database
+ */
+ListDB listdb_load_from_binary_file(char *filename)
+{
+     int fd;
+     struct stat info;
+
+     if ((fd = open(filename, O_RDONLY)) < 0) {
+          fprintf(stderr,"Error: Could not open file %s\n", filename);
+          exit(EXIT_FAILURE);
+     }
+     if (fstat(fd, &info) != 0 || info.st_size < (off_t) sizeof(ListDBHeader)) {
+          fprintf(stderr,"Error: %s is not a binary list database\n", filename);
+          exit(EXIT_FAILURE);
+     }
+
+     size_t size = (size_t) info.st_size;
+     char *mapping = (char *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+     close(fd);
+     if (mapping == MAP_FAILED) {
+          fprintf(stderr,"Error: Could not map file %s\n", filename);
+          exit(EXIT_FAILURE);
+     }
+
+     ListDBHeader *header = (ListDBHeader *) mapping;
+     if (memcmp(header->magic, LISTDB_MAGIC, sizeof(header->magic)) != 0) {
+          fprintf(stderr,"Error: %s is not a binary list database\n", filename);
+          exit(EXIT_FAILURE);
+     }
+     if (header->version != LISTDB_VERSION || header->item_size != sizeof(Item)) {
+          fprintf(stderr,"Error: %s has version %u and items of %u bytes, expected version %u "
+                  "and items of %u bytes\n", filename, header->version, header->item_size,
+                  LISTDB_VERSION, (uint) sizeof(Item));
+          exit(EXIT_FAILURE);
+     }
+
+     ullong *offsets = (ullong *) (mapping + sizeof(ListDBHeader));
+     ullong expected_size = sizeof(ListDBHeader) + (header->size + 1ULL) * sizeof(ullong)
+          + header->number_of_items * sizeof(Item);
+     if (expected_size != size) {
+          fprintf(stderr,"Error: %s has %zu bytes, expected %llu\n", filename, size, expected_size);
+          exit(EXIT_FAILURE);
+     }
+
+     ListDB listdb;
+     listdb_init(&listdb);
+     listdb.size = header->size;
+     listdb.dim = header->dim;
+     listdb.number_of_items = header->number_of_items;
+     listdb.arena = (Item *) (offsets + header->size + 1);
+     listdb.mapping = mapping;
+     listdb.mapping_size = size;
+     listdb.lists = (List *) malloc((listdb.size > 0 ? listdb.size : 1) * sizeof(List));
+
+     uint i;
+     for (i = 0; i < listdb.size; i++) {
+          if (offsets[i] > offsets[i + 1] || offsets[i + 1] > listdb.number_of_items
+              || offsets[i + 1] - offsets[i] > UINT_MAX) {
+               fprintf(stderr,"Error: %s has a corrupted offset for list %u\n", filename, i);
+               exit(EXIT_FAILURE);
+          }
+          listdb.lists[i].size = (uint) (offsets[i + 1] - offsets[i]);
+          listdb.lists[i].capacity = 0;
+          listdb.lists[i].data = listdb.arena + offsets[i];
+     }
+
+     return listdb;
+}
+
+/**
+ * @brief Saves a list database in a binary file that can be loaded without
+ *        parsing or copying (listdb_load_from_binary_file).
+ *        Format (native byte order):
+ *             header (ListDBHeader)
+ *             offsets of the lists in the items (size + 1 ullong values)
+ *             items (item and frequency, one list after the other)
+ *
+ * @param filename File where the list database will be saved
+ * @param listdb List database to save
+ */
+void listdb_save_to_binary_file(char *filename, ListDB *listdb)
+{
+     FILE *file;     
+     if (!(file = fopen(filename,"wb"))) {
+          fprintf(stderr,"Error: Could not create file %s\n", filename);
+          exit(EXIT_FAILURE);
+     }
+
+     uint i;
+     ListDBHeader header;
+     memset(&header, 0, sizeof(header));
+     memcpy(header.magic, LISTDB_MAGIC, sizeof(header.magic));
+     header.version = LISTDB_VERSION;
+     header.size = listdb->size;
+     header.dim = listdb->dim;
+     header.item_size = sizeof(Item);
+     for (i = 0; i < listdb->size; i++)
+          header.number_of_items += listdb->lists[i].size;
+     fwrite(&header, sizeof(header), 1, file);
+
+     ullong offset = 0;
+     for (i = 0; i <= listdb->size; i++) {
+          fwrite(&offset, sizeof(ullong), 1, file);
+          if (i < listdb->size)
+               offset += listdb->lists[i].size;
+     }
+
+     for (i = 0; i < listdb->size; i++)
+          fwrite(listdb->lists[i].data, sizeof(Item), listdb->lists[i].size, file);
+
+     if (ferror(file) || fclose(file)) {
+          fprintf(stderr,"Error: Could not write file %s\n", filename);
+          exit(EXIT_FAILURE);
+     }
+}
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "listdb.h"
+#include "imhkernel.h"
+
+#define red "\033[0;31m"
+#define green "\033[0;32m"
+#define none "\033[0m"
+
+#define NUMBER_OF_PAIRS 2000
+#define REPETITIONS 20
+#define DIM 1000000
+
+typedef uint (*Kernel)(const uint *, uint, const uint *, uint);
+
+/**
+ * @brief Fills an array with distinct random items in increasing order,
+ *        spread over [0, dim) with random gaps
+ */
+void random_set(uint *items, uint size, uint dim)
+{
+     uint i, gap = 2 * (dim / size) - 1;
+     uint item = rand() % (gap + 1);
+
+     for (i = 0; i < size; i++) {
+          items[i] = item;
+          item += 1 + rand() % gap;
+     }
+}
+
+/**
+ * @brief Times a kernel over pairs of sets and adds up the intersection sizes
+ */
+double bench_kernel(uint **a, uint size_a, uint **b, uint size_b, Kernel kernel, ullong *total)
+{
+     uint i, r;
+     clock_t start = clock();
+
+     *total = 0;
+     for (r = 0; r < REPETITIONS; r++)
+          for (i = 0; i < NUMBER_OF_PAIRS; i++)
+               *total += kernel(a[i], size_a, b[i], size_b);
+
+     return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+/**
+ * @brief Times the merge of lists of items with their frequencies
+ */
+double bench_lists(List *a, List *b, ullong *total)
+{
+     uint i, r;
+     clock_t start = clock();
+
+     *total = 0;
+     for (r = 0; r < REPETITIONS; r++)
+          for (i = 0; i < NUMBER_OF_PAIRS; i++)
+               *total += list_intersection_size(&a[i], &b[i]);
+
+     return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+/**
+ * @brief Times the probe of a bitmap of the first set with the items of the second
+ */
+double bench_bitmap(uint **a, uint size_a, uint **b, uint size_b, ullong *total)
+{
+     uint i, j, r;
+     ullong **bitmaps = (ullong **) malloc(NUMBER_OF_PAIRS * sizeof(ullong *));
+     for (i = 0; i < NUMBER_OF_PAIRS; i++) {
+          bitmaps[i] = (ullong *) calloc(a[i][size_a - 1] / 64 + 1, sizeof(ullong));
+          for (j = 0; j < size_a; j++)
+               bitmaps[i][a[i][j] >> 6] |= 1ULL << (a[i][j] & 63);
+     }
+
+     clock_t start = clock();
+     *total = 0;
+     for (r = 0; r < REPETITIONS; r++)
+          for (i = 0; i < NUMBER_OF_PAIRS; i++)
+               *total += imhkernel_intersect_bitmap(bitmaps[i], a[i][size_a - 1], b[i], size_b);
+     double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+     for (i = 0; i < NUMBER_OF_PAIRS; i++)
+          free(bitmaps[i]);
+     free(bitmaps);
+
+     return seconds;
+}
+
+void bench_sizes(uint size_a, uint size_b, uint dim)
+{
+     uint i, j, level;
+     uint **a = (uint **) malloc(NUMBER_OF_PAIRS * sizeof(uint *));
+     uint **b = (uint **) malloc(NUMBER_OF_PAIRS * sizeof(uint *));
+     List *lists_a = (List *) malloc(NUMBER_OF_PAIRS * sizeof(List));
+     List *lists_b = (List *) malloc(NUMBER_OF_PAIRS * sizeof(List));
+     for (i = 0; i < NUMBER_OF_PAIRS; i++) {
+          a[i] = (uint *) malloc(size_a * sizeof(uint));
+          b[i] = (uint *) malloc(size_b * sizeof(uint));
+          random_set(a[i], size_a, dim);
+          random_set(b[i], size_b, dim);
+          lists_a[i] = list_create(size_a);
+          lists_b[i] = list_create(size_b);
+          for (j = 0; j < size_a; j++)
+               lists_a[i].data[j] = list_make_item(a[i][j], 1);
+          for (j = 0; j < size_b; j++)
+               lists_b[i].data[j] = list_make_item(b[i][j], 1);
+     }
+
+     printf("Sizes %u and %u (dim %u)\n", size_a, size_b, dim);
+     ullong expected, total;
+     printf("   %-22s %8.3f s\n", "merge of lists", bench_lists(lists_a, lists_b, &expected));
+
+     Kernel kernels[] = {imhkernel_intersect_scalar,
+                         imhkernel_intersect_avx2};
+     for (level = IMHKERNEL_SCALAR; level <= imhkernel_level() && level <= IMHKERNEL_AVX2; level++) {
+          double seconds = bench_kernel(a, size_a, b, size_b, kernels[level], &total);
+          printf("   merge (%-7s)        %8.3f s %s%s%s\n", imhkernel_name(level), seconds,
+                 total == expected ? green : red, total == expected ? "equal" : "DIFFERENT", none);
+     }
+     double seconds = bench_kernel(a, size_a, b, size_b, imhkernel_intersect_gallop, &total);
+     printf("   %-22s %8.3f s %s%s%s\n", "gallop", seconds,
+            total == expected ? green : red, total == expected ? "equal" : "DIFFERENT", none);
+     seconds = bench_bitmap(a, size_a, b, size_b, &total);
+     printf("   %-22s %8.3f s %s%s%s\n", "bitmap probe", seconds,
+            total == expected ? green : red, total == expected ? "equal" : "DIFFERENT", none);
+     seconds = bench_kernel(a, size_a, b, size_b, imhkernel_intersection_size, &total);
+     printf("   %-22s %8.3f s %s%s%s\n", "adaptive", seconds,
+            total == expected ? green : red, total == expected ? "equal" : "DIFFERENT", none);
+
+     for (i = 0; i < NUMBER_OF_PAIRS; i++) {
+          free(a[i]);
+          free(b[i]);
+          list_destroy(&lists_a[i]);
+          list_destroy(&lists_b[i]);
+     }
+     free(a);
+     free(b);
+     free(lists_a);
+     free(lists_b);
+}
+
+int main(int argc, char **argv)
+{
+     srand(1123123123);
+     printf("Best kernel: %s\n", imhkernel_name(imhkernel_level()));
+
+     bench_sizes(100, 100, 1000);
+     bench_sizes(1000, 1000, 10000);
+     bench_sizes(1000, 1000, DIM);
+     bench_sizes(200, 2000, 10000);
+     bench_sizes(10, 5000, 50000);
+     bench_sizes(5000, 10, 50000);
+     bench_sizes(30, 30, 5000);
+
+     return 0;
+}
@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+#include "mt64.h"
+#include "listdb.h"
+#include "iminhash.h"
+#include "imhkernel.h"
+
+#define red "\033[0;31m"
+#define green "\033[0;32m"
+#define none "\033[0m"
+
+#define NUMBER_OF_LISTS 2000
+#define MAX_LIST_SIZE 200
+#define DIM 100000
+#define TUPLE_SIZE 3
+#define NUMBER_OF_TABLES 50
+
+typedef void (*Kernel)(List *, ullong *, uint, ullong *);
+typedef void (*RankKernel)(List *, uint *, uint, uint, uint, ullong *);
+
+/**
+ * @brief Times the per-permutation loop with a dense array of random values
+ */
+double bench_permutation_loop(ListDB *listdb, HashTable *tables, uint number_of_tables,
+                              ullong *checksum)
+{
+     uint i, j, k;
+     clock_t start = clock();
+
+     *checksum = 0;
+     for (i = 0; i < listdb->size; i++)
+          for (j = 0; j < number_of_tables; j++)
+               for (k = 0; k < tables[j].tuple_size; k++)
+                    *checksum ^= imh_compute_minhash_permutation(&listdb->lists[i],
+                                                                 &tables[j].permutations[k * tables[j].dim]);
+
+     return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+/**
+ * @brief Times the per-permutation loop with hashed MinHash functions
+ */
+double bench_hashed_loop(ListDB *listdb, ullong *seeds, uint number_of_hashes,
+                         ullong *minhashes)
+{
+     uint i, j;
+     clock_t start = clock();
+
+     for (i = 0; i < listdb->size; i++)
+          for (j = 0; j < number_of_hashes; j++)
+               minhashes[i * number_of_hashes + j] = imh_compute_minhash_hashed(&listdb->lists[i],
+                                                                                seeds[j]);
+
+     return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+/**
+ * @brief Times a one-sweep kernel with hashed MinHash functions
+ */
+double bench_kernel(ListDB *listdb, ullong *seeds, uint number_of_hashes,
+                    ullong *minhashes, Kernel kernel)
+{
+     uint i;
+     clock_t start = clock();
+
+     for (i = 0; i < listdb->size; i++)
+          kernel(&listdb->lists[i], seeds, number_of_hashes, &minhashes[i * number_of_hashes]);
+
+     return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+/**
+ * @brief Times a one-sweep kernel with an item-major rank store
+ *        (one column at a time when number_of_columns is 1)
+ */
+double bench_rank_kernel(ListDB *listdb, uint *ranks, uint stride, uint number_of_hashes,
+                         uint number_of_columns, ullong *minhashes, RankKernel kernel)
+{
+     uint i, j;
+     clock_t start = clock();
+
+     for (i = 0; i < listdb->size; i++)
+          for (j = 0; j < number_of_hashes; j += number_of_columns)
+               kernel(&listdb->lists[i], ranks, stride, j, number_of_columns,
+                      &minhashes[i * number_of_hashes + j]);
+
+     return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char **argv)
+{
+     uint i, level;
+     uint number_of_hashes = TUPLE_SIZE * NUMBER_OF_TABLES;
+     Kernel kernels[] = {imhkernel_minhash_hashed_scalar,
+                         imhkernel_minhash_hashed_avx2,
+                         imhkernel_minhash_hashed_avx512};
+
+     srand(1123123123);
+     imh_init_rng(1123123123);
+     ListDB listdb = listdb_random(NUMBER_OF_LISTS, MAX_LIST_SIZE, DIM);
+     listdb_delete_smallest(&listdb, 1);
+
+     printf("Lists: %u, tables: %u, tuple size: %u, dim: %u, best kernel: %s\n",
+            listdb.size, NUMBER_OF_TABLES, TUPLE_SIZE, DIM, imhkernel_name(imhkernel_level()));
+
+     HashTable *tables = (HashTable *) malloc(NUMBER_OF_TABLES * sizeof(HashTable));
+     for (i = 0; i < NUMBER_OF_TABLES; i++) {
+          tables[i] = imh_create_table(2, TUPLE_SIZE, DIM, 2);
+          imh_generate_permutations(DIM, TUPLE_SIZE, tables[i].permutations);
+     }
+     ullong checksum;
+     printf("%-28s %8.3f s\n", "permutations, per function",
+            bench_permutation_loop(&listdb, tables, NUMBER_OF_TABLES, &checksum));
+
+     ullong *seeds = (ullong *) malloc(number_of_hashes * sizeof(ullong));
+     for (i = 0; i < number_of_hashes; i++)
+          seeds[i] = genrand64_int64();
+     ullong *expected = (ullong *) malloc(listdb.size * number_of_hashes * sizeof(ullong));
+     ullong *minhashes = (ullong *) malloc(listdb.size * number_of_hashes * sizeof(ullong));
+     printf("%-28s %8.3f s\n", "hashed, per function",
+            bench_hashed_loop(&listdb, seeds, number_of_hashes, expected));
+
+     for (level = IMHKERNEL_SCALAR; level <= imhkernel_level(); level++) {
+          double seconds = bench_kernel(&listdb, seeds, number_of_hashes, minhashes, kernels[level]);
+          uint equal = 1;
+          for (i = 0; i < listdb.size * number_of_hashes; i++)
+               if (minhashes[i] != expected[i])
+                    equal = 0;
+          printf("hashed, one sweep (%-7s) %8.3f s %s%s%s\n", imhkernel_name(level), seconds,
+                 equal ? green : red, equal ? "equal" : "DIFFERENT", none);
+     }
+
+     RankKernel rank_kernels[] = {imhkernel_minhash_ranks_scalar,
+                                  imhkernel_minhash_ranks_avx2,
+                                  imhkernel_minhash_ranks_avx512};
+     uint stride = imh_get_rank_stride(number_of_hashes);
+     uint *ranks = imh_create_ranks(DIM, stride);
+     imh_generate_ranks(DIM, number_of_hashes, stride, ranks);
+     printf("%-28s %8.3f s\n", "ranks, per function",
+            bench_rank_kernel(&listdb, ranks, stride, number_of_hashes, 1, expected,
+                              imhkernel_minhash_ranks_scalar));
+     for (level = IMHKERNEL_SCALAR; level <= imhkernel_level(); level++) {
+          double seconds = bench_rank_kernel(&listdb, ranks, stride, number_of_hashes,
+                                             number_of_hashes, minhashes, rank_kernels[level]);
+          uint equal = 1;
+          for (i = 0; i < listdb.size * number_of_hashes; i++)
+               if (minhashes[i] != expected[i])
+                    equal = 0;
+          printf("ranks, one sweep (%-7s)  %8.3f s %s%s%s\n", imhkernel_name(level), seconds,
+                 equal ? green : red, equal ? "equal" : "DIFFERENT", none);
+     }
+     free(ranks);
+
+     for (i = 0; i < NUMBER_OF_TABLES; i++)
+          imh_destroy_table(&tables[i]);
+     free(tables);
+     free(seeds);
+     free(expected);
+     free(minhashes);
+     listdb_destroy(&listdb);
+
+     return 0;
+}
@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
 #include <time.h>
 #include <math.h>
 #include "listdb.h"
@@ -18,7 +20,7 @@
 
 
 
-void test_build(uint sublist_size)
+void test_build(uint sublist_size, uint scheme)
 {
      ListDB listdb = listdb_random(50,8,20);
      listdb_delete_smallest(&listdb, 3);
@@ -33,12 +35,12 @@ void test_build(uint sublist_size)
      printf("Database of lists\n");
      listdb_print(&listdb);
 
-     HashIndex hash_index = imhsearch_build(&listdb, 10, 3, 2048, sublist_size);
+     HashIndex hash_index = imhsearch_build(&listdb, 10, 3, 2048, sublist_size, scheme);
      imhsearch_print_index_head(&hash_index);
      imhsearch_print_index_tables(&hash_index);
 }
 
-void test_query(uint sublist_size)
+void test_query(uint sublist_size, uint scheme)
 {
      ListDB listdb = listdb_random(50,8,20);
      listdb_delete_smallest(&listdb, 3);
@@ -53,7 +55,7 @@ void test_query(uint sublist_size)
      printf("========== Database of lists ==========\n");
      listdb_print(&listdb);
 
-     HashIndex hash_index = imhsearch_build(&listdb, 20, 3, 256, sublist_size);
+     HashIndex hash_index = imhsearch_build(&listdb, 20, 3, 256, sublist_size, scheme);
      imhsearch_print_index_head(&hash_index);
      imhsearch_print_index_tables(&hash_index);
 
@@ -74,7 +76,7 @@ void test_query(uint sublist_size)
 
 }
 
-void test_query_multi(uint sublist_size)
+void test_query_multi(uint sublist_size, uint scheme)
 {
      ListDB listdb = listdb_random(50,8,20);
      listdb_delete_smallest(&listdb, 3);
@@ -89,7 +91,7 @@ void test_query_multi(uint sublist_size)
      printf("========== Database of lists ==========\n");
      listdb_print(&listdb);
 
-     HashIndex hash_index = imhsearch_build(&listdb, 20, 3, 256, sublist_size);
+     HashIndex hash_index = imhsearch_build(&listdb, 20, 3, 256, sublist_size, scheme);
      imhsearch_print_index_head(&hash_index);
      imhsearch_print_index_tables(&hash_index);
 
@@ -114,13 +116,655 @@ void test_query_multi(uint sublist_size)
           list_print(&neighbors.lists[i]);
      }
 }
+void test_freeze(uint sublist_size, uint scheme)
+{
+     uint i;
+     ListDB listdb = listdb_random(50,8,20);
+     listdb_delete_smallest(&listdb, 3);
+     listdb_apply_to_all(&listdb, list_sort_by_item);
+     listdb_apply_to_all(&listdb, list_unique);
+
+     ListDB queries = listdb_random(10, 8, 20);
+     listdb_delete_smallest(&queries, 3);
+     listdb_apply_to_all(&queries, list_sort_by_item);
+     listdb_apply_to_all(&queries, list_unique);
+
+     HashIndex hash_index = imhsearch_build(&listdb, 20, 3, 256, sublist_size, scheme);
+     ListDB neighbors = imhsearch_query_multi(&queries, &hash_index);
+
+     imhsearch_freeze(&hash_index);
+     printf("========== Frozen tables ==========\n");
+     imhsearch_print_index_tables(&hash_index);
+     ListDB frozen_neighbors = imhsearch_query_multi(&queries, &hash_index);
+
+     uint equal = 1;
+     for (i = 0; i < queries.size; i++)
+          if (!list_equal(&neighbors.lists[i], &frozen_neighbors.lists[i]))
+               equal = 0;
+     printf("Same neighbors after freezing: %s%s%s\n",
+            equal ? green : red, equal ? "yes" : "no", none);
+
+     imhsearch_destroy(&hash_index);
+     listdb_destroy(&neighbors);
+     listdb_destroy(&frozen_neighbors);
+     listdb_destroy(&queries);
+     listdb_destroy(&listdb);
+}
+
+/**
+ * @brief Checks that querying leaves the hash tables untouched
+ */
+void test_query_read_only(uint sublist_size, uint scheme)
+{
+     uint i, j;
+     ListDB listdb = listdb_random(50,8,20);
+     listdb_delete_smallest(&listdb, 3);
+     listdb_apply_to_all(&listdb, list_sort_by_item);
+     listdb_apply_to_all(&listdb, list_unique);
+
+     ListDB queries = listdb_random(50, 8, 40);
+     listdb_delete_smallest(&queries, 3);
+     listdb_apply_to_all(&queries, list_sort_by_item);
+     listdb_apply_to_all(&queries, list_unique);
+
+     HashIndex hash_index = imhsearch_build(&listdb, 20, 3, 256, sublist_size, scheme);
+     uint *keys = (uint *) malloc(hash_index.number_of_tables * 256 * sizeof(uint));
+     for (i = 0; i < hash_index.number_of_tables; i++)
+          memcpy(&keys[i * 256], hash_index.hash_tables[i].keys, 256 * sizeof(uint));
+     
+     uint misses = 0;
+     for (i = 0; i < queries.size; i++)
+          for (j = 0; j < hash_index.number_of_tables; j++)
+               if (imh_find_index(&queries.lists[i], &hash_index.hash_tables[j]) == IMH_NO_BUCKET)
+                    misses++;
+     ListDB neighbors = imhsearch_query_multi(&queries, &hash_index);
+
+     uint unchanged = 1;
+     for (i = 0; i < hash_index.number_of_tables; i++)
+          if (memcmp(&keys[i * 256], hash_index.hash_tables[i].keys, 256 * sizeof(uint)) != 0)
+               unchanged = 0;
+     printf("Lookups missing a bucket: %u of %u\n", misses, queries.size * hash_index.number_of_tables);
+     printf("Tables unchanged after querying: %s%s%s\n",
+            unchanged ? green : red, unchanged ? "yes" : "no", none);
+
+     free(keys);
+     imhsearch_destroy(&hash_index);
+     listdb_destroy(&neighbors);
+     listdb_destroy(&queries);
+     listdb_destroy(&listdb);
+}
+
+/**
+ * @brief Checks that parallel queries give the same neighbors for any number of threads
+ */
+void test_query_parallel(uint sublist_size, uint scheme)
+{
+     uint i, threads;
+     ListDB listdb = listdb_random(500,8,50);
+     listdb_delete_smallest(&listdb, 3);
+     listdb_apply_to_all(&listdb, list_sort_by_item);
+     listdb_apply_to_all(&listdb, list_unique);
+
+     ListDB queries = listdb_random(300, 8, 50);
+     listdb_delete_smallest(&queries, 3);
+     listdb_apply_to_all(&queries, list_sort_by_item);
+     listdb_apply_to_all(&queries, list_unique);
+
+     HashIndex hash_index = imhsearch_build(&listdb, 20, 2, 1024, sublist_size, scheme);
+     imhsearch_freeze(&hash_index);
+     ListDB expected = imhsearch_query_multi(&queries, &hash_index);
+     for (i = 0; i < queries.size; i++)
+          imhsearch_sort_custom(&queries.lists[i], &expected.lists[i], &listdb, list_overlap);
+
+     for (threads = 1; threads <= 8; threads *= 2) {
+          ListDB neighbors = imhsearch_query_parallel(&queries, &hash_index, &listdb,
+                                                      list_overlap, threads);
+          uint equal = 1;
+          for (i = 0; i < queries.size; i++)
+               if (!list_equal(&neighbors.lists[i], &expected.lists[i]))
+                    equal = 0;
+          printf("Same neighbors with %u threads: %s%s%s\n", threads,
+                 equal ? green : red, equal ? "yes" : "no", none);
+          listdb_destroy(&neighbors);
+     }
+
+     imhsearch_destroy(&hash_index);
+     listdb_destroy(&expected);
+     listdb_destroy(&queries);
+     listdb_destroy(&listdb);
+}
+
+/**
+ * @brief Checks that an index built in parallel is the same for any number of threads
+ */
+void test_arena(uint sublist_size, uint scheme)
+{
+     uint i;
+     ListDB listdb = listdb_random(500,8,50);
+     listdb_delete_smallest(&listdb, 3);
+     listdb_apply_to_all(&listdb, list_sort_by_item);
+     listdb_apply_to_all(&listdb, list_unique);
+
+     ListDB queries = listdb_random(300, 8, 50);
+     listdb_delete_smallest(&queries, 3);
+     listdb_apply_to_all(&queries, list_sort_by_item);
+     listdb_apply_to_all(&queries, list_unique);
+
+     HashIndex hash_index = imhsearch_build(&listdb, 20, 2, 1024, sublist_size, scheme);
+     ListDB expected = imhsearch_query_parallel(&queries, &hash_index, &listdb, list_jaccard, 1);
+     List first = list_duplicate(&listdb.lists[0]);
+
+     // the same neighbors are found when the lists are in an arena with split columns
+     listdb_split_columns(&listdb);
+     ListDB neighbors = imhsearch_query_parallel(&queries, &hash_index, &listdb, list_jaccard, 1);
+     uint equal = listdb_item_column(&listdb, 0) != NULL;
+     for (i = 0; i < queries.size; i++)
+          if (!list_equal(&neighbors.lists[i], &expected.lists[i]))
+               equal = 0;
+     printf("Same neighbors with lists in an arena: %s%s%s\n",
+            equal ? green : red, equal ? "yes" : "no", none);
+
+     // a list of the arena gets its own items when it grows
+     list_push(&listdb.lists[0], list_make_item(50, 1));
+     uint copied = listdb.lists[0].capacity > 0 && listdb_item_column(&listdb, 0) == NULL
+          && listdb.lists[0].size == first.size + 1 && listdb.lists[1].data == listdb.arena + first.size;
+     list_pop(&listdb.lists[0]);
+     copied = copied && list_equal(&listdb.lists[0], &first);
+     printf("Lists of the arena are copied before growing: %s%s%s\n",
+            copied ? green : red, copied ? "yes" : "no", none);
+
+     // reserving less room than its size still copies all the items of a view
+     List view = listdb.lists[1];
+     list_reserve(&view, 1);
+     uint reserved = view.capacity >= view.size && view.data != listdb.lists[1].data
+          && list_equal(&view, &listdb.lists[1]);
+     printf("Views reserve room for all their items: %s%s%s\n",
+            reserved ? green : red, reserved ? "yes" : "no", none);
+     list_destroy(&view);
+
+     list_destroy(&first);
+     listdb_destroy(&neighbors);
+     imhsearch_destroy(&hash_index);
+     listdb_destroy(&expected);
+     listdb_destroy(&queries);
+     listdb_destroy(&listdb);
+}
+
+void test_query_stream(uint sublist_size, uint scheme, uint batch_size)
+{
+     uint i;
+     char query_file[] = "/tmp/test_queriesXXXXXX";
+     char output_file[] = "/tmp/test_neighborsXXXXXX";
+     int fd = mkstemp(query_file);
+     int fd2 = mkstemp(output_file);
+     if (fd < 0 || fd2 < 0) {
+          printf("Could not create a temporary file\n");
+          return;
+     }
+     close(fd);
+     close(fd2);
+
+     ListDB listdb = listdb_random(500,8,50);
+     listdb_delete_smallest(&listdb, 3);
+     listdb_apply_to_all(&listdb, list_sort_by_item);
+     listdb_apply_to_all(&listdb, list_unique);
+
+     ListDB queries = listdb_random(300, 8, 50);
+     listdb_delete_smallest(&queries, 3);
+     listdb_apply_to_all(&queries, list_sort_by_item);
+     listdb_apply_to_all(&queries, list_unique);
+     listdb_save_to_file(query_file, &queries);
+
+     HashIndex hash_index = imhsearch_build(&listdb, 20, 2, 1024, sublist_size, scheme);
+     ListDB expected = imhsearch_query_parallel(&queries, &hash_index, &listdb, list_jaccard, 1);
+
+     // queries are read and neighbors are written a batch at a time
+     FILE *input = fopen(query_file, "r");
+     FILE *output = fopen(output_file, "w");
+     ListReader reader;
+     ListWriter writer;
+     listdb_reader_open(&reader, input, query_file);
+     listdb_writer_open(&writer, output, output_file);
+     ullong number_of_queries = imhsearch_query_stream(&reader, batch_size, &hash_index, &listdb,
+                                                       list_jaccard, 0, 0, 0.0, 2, &writer, 0);
+     listdb_writer_close(&writer);
+     listdb_reader_close(&reader);
+     fclose(input);
+     fclose(output);
+
+     ListDB neighbors = listdb_load_from_file(output_file);
+     uint equal = number_of_queries == queries.size && neighbors.size == expected.size;
+     for (i = 0; equal && i < expected.size; i++)
+          if (!list_equal(&neighbors.lists[i], &expected.lists[i]))
+               equal = 0;
+     printf("Same neighbors streaming batches of %u queries: %s%s%s\n", batch_size,
+            equal ? green : red, equal ? "yes" : "no", none);
+     remove(query_file);
+     remove(output_file);
+
+     listdb_destroy(&neighbors);
+     imhsearch_destroy(&hash_index);
+     listdb_destroy(&expected);
+     listdb_destroy(&queries);
+     listdb_destroy(&listdb);
+}
+
+/**
+ * @brief Finds the neighbors of a query by appending the buckets it hits
+ *        and sorting them, as a reference for the merge of imhsearch_query
+ */
+List reference_query(List *query, HashIndex *hash_index)
+{
+     uint i;
+     List neighbors;
+     list_init(&neighbors);
+     ullong *minhashes = (ullong *) malloc(hash_index->number_of_tables
+                                           * hash_index->tuple_size * sizeof(ullong));
+     imhsearch_compute_minhashes(query, hash_index, minhashes);
+     for (i = 0; i < hash_index->number_of_tables; i++) {
+          uint index = imh_find_index_tuple(&minhashes[i * hash_index->tuple_size],
+                                            &hash_index->hash_tables[i]);
+          imh_append_bucket(&neighbors, &hash_index->hash_tables[i], index);
+     }
+     free(minhashes);
+     list_sort_by_item(&neighbors);
+     list_unique(&neighbors);
+
+     return neighbors;
+}
+
+/**
+ * @brief Checks that a hash index gives the neighbors of reference_query
+ *        with the same number of collisions
+ */
+uint same_as_reference(ListDB *queries, HashIndex *hash_index)
+{
+     uint i, j, equal = 1;
+     for (i = 0; i < queries->size; i++) {
+          List neighbors = imhsearch_query(&queries->lists[i], hash_index);
+          List expected = reference_query(&queries->lists[i], hash_index);
+          if (neighbors.size != expected.size)
+               equal = 0;
+          for (j = 0; equal && j < neighbors.size; j++)
+               if (neighbors.data[j].item != expected.data[j].item
+                   || neighbors.data[j].freq != expected.data[j].freq)
+                    equal = 0;
+          list_destroy(&neighbors);
+          list_destroy(&expected);
+     }
+
+     return equal;
+}
+
+void test_merge_buckets(uint sublist_size, uint scheme)
+{
+     uint i, j;
+     ListDB listdb = listdb_random(500,8,50);
+     listdb_delete_smallest(&listdb, 3);
+     listdb_apply_to_all(&listdb, list_sort_by_item);
+     listdb_apply_to_all(&listdb, list_unique);
+
+     ListDB queries = listdb_random(300, 8, 50);
+     listdb_delete_smallest(&queries, 3);
+     listdb_apply_to_all(&queries, list_sort_by_item);
+     listdb_apply_to_all(&queries, list_unique);
+
+     // small tables, so buckets are hit by many lists
+     HashIndex hash_index = imhsearch_build(&listdb, 20, 1, 64, sublist_size, scheme);
+     uint equal = same_as_reference(&queries, &hash_index);
+     printf("Merged buckets of frozen tables: %s%s%s\n",
+            equal ? green : red, equal ? "same as sorting" : "DIFFERENT", none);
+     imhsearch_destroy(&hash_index);
+
+     // tables that are not frozen, storing the lists in increasing and decreasing order
+     uint order;
+     for (order = 0; order < 2; order++) {
+          imhsearch_init_index(&hash_index);
+          hash_index.number_of_tables = 20;
+          hash_index.tuple_size = 1;
+          hash_index.number_of_lists = listdb.size;
+          hash_index.hash_tables = (HashTable *) malloc(20 * sizeof(HashTable));
+          for (i = 0; i < 20; i++) {
+               hash_index.hash_tables[i] = imh_create_table(64, 1, listdb.dim, 1);
+               imh_generate_permutations(listdb.dim, 1, hash_index.hash_tables[i].permutations);
+               for (j = 0; j < listdb.size; j++) {
+                    uint id = order == 0 ? j : listdb.size - 1 - j;
+                    imh_store_list(&listdb.lists[id], id, &hash_index.hash_tables[i]);
+               }
+          }
+          equal = same_as_reference(&queries, &hash_index);
+          printf("Merged buckets of tables stored in %s order: %s%s%s\n",
+                 order == 0 ? "increasing" : "decreasing",
+                 equal ? green : red, equal ? "same as sorting" : "DIFFERENT", none);
+          imhsearch_destroy(&hash_index);
+     }
+
+     listdb_destroy(&queries);
+     listdb_destroy(&listdb);
+}
+
+void test_query_top(uint sublist_size, uint scheme, uint k)
+{
+     uint i, j;
+     ListDB listdb = listdb_random(500,8,50);
+     listdb_delete_smallest(&listdb, 3);
+     listdb_apply_to_all(&listdb, list_sort_by_item);
+     listdb_apply_to_all(&listdb, list_unique);
+
+     ListDB queries = listdb_random(300, 8, 50);
+     listdb_delete_smallest(&queries, 3);
+     listdb_apply_to_all(&queries, list_sort_by_item);
+     listdb_apply_to_all(&queries, list_unique);
+
+     HashIndex hash_index = imhsearch_build(&listdb, 20, 2, 1024, sublist_size, scheme);
+     double *scores = (double *) malloc(listdb.size * sizeof(double));
+     double *top_scores = (double *) malloc(k * sizeof(double));
+
+     // reranking all the candidates gives the scores of a full sort
+     uint exact = 1, by_collisions = 1;
+     for (i = 0; i < queries.size; i++) {
+          List all = imhsearch_query(&queries.lists[i], &hash_index);
+          imhsearch_sort_scored(&queries.lists[i], &all, &listdb, list_jaccard, scores);
+          List top = imhsearch_query_top(&queries.lists[i], &hash_index, &listdb, list_jaccard,
+                                         k, listdb.size, top_scores);
+          if (top.size != (all.size < k ? all.size : k))
+               exact = 0;
+          for (j = 0; exact && j < top.size; j++)
+               if (top_scores[j] != scores[j]
+                   || top_scores[j] != list_jaccard(&queries.lists[i], &listdb.lists[top.data[j].item]))
+                    exact = 0;
+          list_destroy(&top);
+
+          // without a score, neighbors are ranked by their number of collisions
+          top = imhsearch_query_top(&queries.lists[i], &hash_index, &listdb, NULL, k, 0, top_scores);
+          for (j = 0; j < top.size; j++)
+               if (top_scores[j] != top.data[j].freq
+                   || (j > 0 && top.data[j].freq > top.data[j - 1].freq))
+                    by_collisions = 0;
+          list_destroy(&top);
+          list_destroy(&all);
+     }
+     printf("Top %u neighbors reranking all candidates: %s%s%s\n", k,
+            exact ? green : red, exact ? "same scores as sorting" : "DIFFERENT", none);
+     printf("Top %u neighbors by collisions: %s%s%s\n", k,
+            by_collisions ? green : red, by_collisions ? "yes" : "no", none);
+
+     // the same neighbors are found by several threads
+     ListDB expected = imhsearch_query_top_parallel(&queries, &hash_index, &listdb, list_jaccard,
+                                                    k, 3 * k, 0.0, 1, NULL);
+     ListDB neighbors = imhsearch_query_top_parallel(&queries, &hash_index, &listdb, list_jaccard,
+                                                     k, 3 * k, 0.0, 4, NULL);
+     uint equal = 1;
+     for (i = 0; i < queries.size; i++)
+          if (!list_equal(&neighbors.lists[i], &expected.lists[i]) || neighbors.lists[i].size > k)
+               equal = 0;
+     printf("Same top %u neighbors with 4 threads: %s%s%s\n", k,
+            equal ? green : red, equal ? "yes" : "no", none);
+
+     free(scores);
+     free(top_scores);
+     listdb_destroy(&neighbors);
+     listdb_destroy(&expected);
+     imhsearch_destroy(&hash_index);
+     listdb_destroy(&queries);
+     listdb_destroy(&listdb);
+}
+
+void test_query_threshold(uint sublist_size, uint scheme)
+{
+     uint i, j, t, f;
+     double thresholds[] = {0.25, 0.5, 2.0 / 3.0, 1.0};
+     double (*funcs[])(List *, List *) = {list_overlap, list_jaccard};
+     const char *names[] = {"overlap", "Jaccard"};
+     ListDB listdb = listdb_random(500,8,50);
+     listdb_delete_smallest(&listdb, 3);
+     listdb_apply_to_all(&listdb, list_sort_by_item);
+     listdb_apply_to_all(&listdb, list_unique);
+
+     ListDB queries = listdb_random(300, 8, 50);
+     listdb_delete_smallest(&queries, 3);
+     listdb_apply_to_all(&queries, list_sort_by_item);
+     listdb_apply_to_all(&queries, list_unique);
+
+     HashIndex hash_index = imhsearch_build(&listdb, 20, 2, 1024, sublist_size, scheme);
+     listdb_split_columns(&listdb);
+
+     // the neighbors reaching a threshold are the ones of a full rerank with that score
+     for (f = 0; f < 2; f++) {
+          uint equal = 1;
+          for (t = 0; t < 4; t++) {
+               for (i = 0; i < queries.size; i++) {
+                    List all = imhsearch_query(&queries.lists[i], &hash_index);
+                    double *scores;
+                    List neighbors = imhsearch_query_threshold(&queries.lists[i], &hash_index,
+                                                               &listdb, funcs[f], thresholds[t],
+                                                               &scores);
+                    uint expected = 0;
+                    for (j = 0; j < all.size; j++)
+                         if (funcs[f](&queries.lists[i], &listdb.lists[all.data[j].item]) >= thresholds[t])
+                              expected++;
+                    if (neighbors.size != expected)
+                         equal = 0;
+                    for (j = 0; equal && j < neighbors.size; j++)
+                         if (scores[j] != funcs[f](&queries.lists[i], &listdb.lists[neighbors.data[j].item])
+                             || scores[j] < thresholds[t] || (j > 0 && scores[j] > scores[j - 1]))
+                              equal = 0;
+                    free(scores);
+                    list_destroy(&neighbors);
+                    list_destroy(&all);
+               }
+          }
+          printf("Neighbors reaching a threshold of %s: %s%s%s\n", names[f],
+                 equal ? green : red, equal ? "same as a full rerank" : "DIFFERENT", none);
+     }
+
+     // the intersection stops early only when it cannot reach the needed size
+     uint bounded = 1;
+     for (i = 0; i + 1 < listdb.size; i++) {
+          uint size = list_intersection_size(&listdb.lists[i], &listdb.lists[i + 1]);
+          for (j = 0; j <= size + 1; j++) {
+               uint partial = list_intersection_size_bounded(&listdb.lists[i], &listdb.lists[i + 1], j);
+               if ((j <= size && partial != size) || (j > size && partial >= j))
+                    bounded = 0;
+          }
+     }
+     printf("Bounded intersection size: %s%s%s\n",
+            bounded ? green : red, bounded ? "yes" : "no", none);
+
+     imhsearch_destroy(&hash_index);
+     listdb_destroy(&queries);
+     listdb_destroy(&listdb);
+}
+
+void test_save_index(uint sublist_size, uint scheme)
+{
+     uint i;
+     char filename[] = "/tmp/test_indexXXXXXX";
+     int fd = mkstemp(filename);
+     if (fd < 0) {
+          printf("Could not create a temporary file\n");
+          return;
+     }
+     close(fd);
+
+     ListDB listdb = listdb_random(500,8,50);
+     listdb_delete_smallest(&listdb, 3);
+     listdb_apply_to_all(&listdb, list_sort_by_item);
+     listdb_apply_to_all(&listdb, list_unique);
+
+     ListDB queries = listdb_random(300, 8, 50);
+     listdb_delete_smallest(&queries, 3);
+     listdb_apply_to_all(&queries, list_sort_by_item);
+     listdb_apply_to_all(&queries, list_unique);
+
+     HashIndex hash_index = imhsearch_build(&listdb, 20, 2, 1024, sublist_size, scheme);
+     ListDB expected = imhsearch_query_multi(&queries, &hash_index);
+     imhsearch_save_index(filename, &hash_index);
+     imhsearch_destroy(&hash_index);
+
+     HashIndex loaded = imhsearch_load_index(filename);
+     ListDB neighbors = imhsearch_query_multi(&queries, &loaded);
+     uint equal = loaded.number_of_lists == listdb.size && loaded.scheme == scheme;
+     for (i = 0; i < queries.size; i++)
+          if (!list_equal(&neighbors.lists[i], &expected.lists[i]))
+               equal = 0;
+     printf("Same neighbors with a saved %s index: %s%s%s\n", imh_scheme_name(scheme),
+            equal ? green : red, equal ? "yes" : "no", none);
+     remove(filename);
+
+     imhsearch_destroy(&loaded);
+     listdb_destroy(&neighbors);
+     listdb_destroy(&expected);
+     listdb_destroy(&queries);
+     listdb_destroy(&listdb);
+}
+
+void test_signatures(uint sublist_size, uint scheme, uint k)
+{
+     uint i, j;
+     char filename[] = "/tmp/test_indexXXXXXX";
+     int fd = mkstemp(filename);
+     if (fd < 0) {
+          printf("Could not create a temporary file\n");
+          return;
+     }
+     close(fd);
+
+     ListDB listdb = listdb_random(500,80,200);
+     listdb_delete_smallest(&listdb, 3);
+     listdb_apply_to_all(&listdb, list_sort_by_item);
+     listdb_apply_to_all(&listdb, list_unique);
+
+     ListDB queries = listdb_random(300, 80, 200);
+     listdb_delete_smallest(&queries, 3);
+     listdb_apply_to_all(&queries, list_sort_by_item);
+     listdb_apply_to_all(&queries, list_unique);
+
+     // signatures are only built and saved when asked for
+     HashIndex hash_index = imhsearch_build(&listdb, 20, 2, 16384, sublist_size, scheme);
+     imhsearch_save_index(filename, &hash_index);
+     HashIndex loaded = imhsearch_load_index(filename);
+     uint optional = hash_index.signatures == NULL && loaded.signatures == NULL;
+     printf("Signatures only built when asked for: %s%s%s\n",
+            optional ? green : red, optional ? "yes" : "no", none);
+     imhsearch_destroy(&loaded);
+
+     imhsearch_build_signatures(&hash_index, &listdb);
+     imhsearch_save_index(filename, &hash_index);
+     loaded = imhsearch_load_index(filename);
+     uint saved = loaded.signatures != NULL
+          && memcmp(loaded.signatures, hash_index.signatures,
+                    listdb.size * IMHSEARCH_SIGNATURE_WORDS * sizeof(ullong)) == 0;
+     printf("Signatures of a saved %s index: %s%s%s\n", imh_scheme_name(scheme),
+            saved ? green : red, saved ? "same" : "DIFFERENT", none);
+     imhsearch_destroy(&loaded);
+     remove(filename);
+
+     // skipping candidates with the signatures does not change the neighbors
+     ListDB top = imhsearch_query_top_parallel(&queries, &hash_index, &listdb, list_jaccard,
+                                               k, 10 * k, 0.0, 1, NULL);
+     ListDB reaching = imhsearch_query_top_parallel(&queries, &hash_index, &listdb, list_overlap,
+                                                    0, 0, 0.5, 1, NULL);
+     ullong *signatures = hash_index.signatures;
+     hash_index.signatures = NULL;
+     ListDB expected_top = imhsearch_query_top_parallel(&queries, &hash_index, &listdb, list_jaccard,
+                                                        k, 10 * k, 0.0, 1, NULL);
+     ListDB expected_reaching = imhsearch_query_top_parallel(&queries, &hash_index, &listdb,
+                                                             list_overlap, 0, 0, 0.5, 1, NULL);
+     hash_index.signatures = signatures;
+     uint equal = 1;
+     for (i = 0; i < queries.size; i++)
+          if (!list_equal(&top.lists[i], &expected_top.lists[i])
+              || !list_equal(&reaching.lists[i], &expected_reaching.lists[i]))
+               equal = 0;
+     printf("Same neighbors skipping candidates with signatures: %s%s%s\n",
+            equal ? green : red, equal ? "yes" : "no", none);
+
+     // a bit set by a common item is in both signatures, so the other
+     // bits of the smallest list bound the intersection
+     uint bounded = 1;
+     for (i = 0; i + 1 < listdb.size; i++) {
+          ullong *signature1 = &signatures[i * IMHSEARCH_SIGNATURE_WORDS];
+          ullong *signature2 = &signatures[(i + 1) * IMHSEARCH_SIGNATURE_WORDS];
+          uint only1 = 0;
+          for (j = 0; j < IMHSEARCH_SIGNATURE_WORDS; j++)
+               only1 += __builtin_popcountll(signature1[j] & ~signature2[j]);
+          if (list_intersection_size(&listdb.lists[i], &listdb.lists[i + 1])
+              > listdb.lists[i].size - only1)
+               bounded = 0;
+     }
+     printf("Intersection bounded by signatures: %s%s%s\n",
+            bounded ? green : red, bounded ? "yes" : "no", none);
+
+     listdb_destroy(&top);
+     listdb_destroy(&reaching);
+     listdb_destroy(&expected_top);
+     listdb_destroy(&expected_reaching);
+     imhsearch_destroy(&hash_index);
+     listdb_destroy(&queries);
+     listdb_destroy(&listdb);
+}
+
+void test_build_parallel(uint sublist_size, uint scheme)
+{
+     uint i, j, threads;
+     ListDB listdb = listdb_random(500,8,50);
+     listdb_delete_smallest(&listdb, 3);
+     listdb_apply_to_all(&listdb, list_sort_by_item);
+     listdb_apply_to_all(&listdb, list_unique);
+
+     imh_init_rng(1123123123);
+     HashIndex expected = imhsearch_build_parallel(&listdb, 10, 2, 1024, sublist_size, scheme, 1);
+     for (threads = 2; threads <= 8; threads *= 2) {
+          imh_init_rng(1123123123);
+          HashIndex hash_index = imhsearch_build_parallel(&listdb, 10, 2, 1024, sublist_size,
+                                                          scheme, threads);
+          uint equal = 1;
+          for (i = 0; i < hash_index.number_of_tables; i++) {
+               HashTable *table = &hash_index.hash_tables[i];
+               HashTable *expected_table = &expected.hash_tables[i];
+               for (j = 0; j < table->table_size; j++)
+                    if (table->keys[j] != expected_table->keys[j] ||
+                        table->offsets[j + 1] != expected_table->offsets[j + 1])
+                         equal = 0;
+               for (j = 0; equal && j < table->offsets[table->table_size]; j++)
+                    if (table->ids[j] != expected_table->ids[j])
+                         equal = 0;
+          }
+          printf("Same %s index with %u threads: %s%s%s\n", imh_scheme_name(scheme), threads,
+                 equal ? green : red, equal ? "yes" : "no", none);
+          imhsearch_destroy(&hash_index);
+     }
+
+     imhsearch_destroy(&expected);
+     listdb_destroy(&listdb);
+}
+
 int main(int argc, char **argv)
 {
      imh_init_rng(1123123123);
      
-     /* test_build(2); */
-     /* test_query(2); */
-     test_query_multi(2);
+     /* test_build(2, IMH_SCHEME_PERMUTATIONS); */
+     /* test_query(2, IMH_SCHEME_PERMUTATIONS); */
+     test_query_multi(2, IMH_SCHEME_PERMUTATIONS);
+     test_query_multi(2, IMH_SCHEME_HASHED);
+     test_query_multi(2, IMH_SCHEME_OPH);
+     test_query_multi(2, IMH_SCHEME_RANKS);
+     test_freeze(2, IMH_SCHEME_PERMUTATIONS);
+     test_query_read_only(2, IMH_SCHEME_HASHED);
+     test_query_parallel(2, IMH_SCHEME_HASHED);
+     test_arena(2, IMH_SCHEME_HASHED);
+     test_query_stream(2, IMH_SCHEME_HASHED, 7);
+     test_merge_buckets(2, IMH_SCHEME_PERMUTATIONS);
+     test_query_top(2, IMH_SCHEME_HASHED, 5);
+     test_query_threshold(2, IMH_SCHEME_HASHED);
+     test_save_index(2, IMH_SCHEME_PERMUTATIONS);
+     test_save_index(2, IMH_SCHEME_HASHED);
+     test_save_index(2, IMH_SCHEME_OPH);
+     test_save_index(2, IMH_SCHEME_RANKS);
+     test_signatures(2, IMH_SCHEME_HASHED, 5);
+     test_build_parallel(2, IMH_SCHEME_PERMUTATIONS);
+     test_build_parallel(2, IMH_SCHEME_RANKS);
  
      return 0;
 }
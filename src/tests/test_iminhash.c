@@ -1,9 +1,12 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <time.h>
 #include <math.h>
 #include "listdb.h"
 #include "iminhash.h"
+#include "imhkernel.h"
 
 #define red "\033[0;31m"
 #define cyan "\033[0;36m"
@@ -50,7 +53,7 @@ void test_create_sublistdb(uint sublist_size)
      }
 }
 
-void test_store_listdb(uint sublist_size)
+void test_store_listdb(uint sublist_size, uint scheme)
 {
      ListDB listdb = listdb_random(50,8,20);
      listdb_delete_smallest(&listdb, 3);
@@ -83,8 +86,13 @@ void test_store_listdb(uint sublist_size)
           list_print(&sublistdb.lists[i]);
      }
 
-     HashTable hash_table = imh_create_table(2048, 3, listdb.dim, sublist_size);
-     imh_generate_permutations(hash_table.dim, hash_table.tuple_size, hash_table.permutations); 
+     HashTable hash_table;
+     if (scheme == IMH_SCHEME_HASHED) {
+          hash_table = imh_create_table_hashed(2048, 3, listdb.dim, sublist_size);
+     } else {
+          hash_table = imh_create_table(2048, 3, listdb.dim, sublist_size);
+          imh_generate_permutations(hash_table.dim, hash_table.tuple_size, hash_table.permutations); 
+     }
      imh_store_sublistdb(&sublistdb, sublistdb_ids, &hash_table);
 
      printf("Buckets\n");
@@ -94,12 +102,513 @@ void test_store_listdb(uint sublist_size)
      }
 }
 
+void test_hashed_minhash(void)
+{
+     uint i, j;
+     ListDB listdb = listdb_random(20, 8, 20);
+     listdb_delete_smallest(&listdb, 1);
+     listdb_apply_to_all(&listdb, list_sort_by_item);
+     listdb_apply_to_all(&listdb, list_unique);
+
+     imh_init_rng(42);
+     HashTable table1 = imh_create_table_hashed(2048, 3, listdb.dim, 2);
+     imh_init_rng(42);
+     HashTable table2 = imh_create_table_hashed(2048, 3, listdb.dim, 2);
+
+     imh_print_head(&table1);
+     uint equal = 1;
+     for (i = 0; i < listdb.size; i++) {
+          for (j = 0; j < table1.tuple_size; j++) {
+               if (imh_compute_minhash(&listdb.lists[i], &table1, j) !=
+                   imh_compute_minhash(&listdb.lists[i], &table2, j))
+                    equal = 0;
+          }
+     }
+     printf("Hashed MinHash values reproducible from seed: %s%s%s\n",
+            equal ? green : red, equal ? "yes" : "no", none);
+
+     imh_destroy_table(&table1);
+     imh_destroy_table(&table2);
+     listdb_destroy(&listdb);
+}
+
+void test_oph(uint number_of_bins)
+{
+     uint i;
+     List list = list_random(8, 20);
+     list_sort_by_item(&list);
+     list_unique(&list);
+     if (list.size == 0)
+          list_push(&list, list_make_item(7, 1));
+     printf("========== One permutation hashing ==========\n");
+     list_print(&list);
+
+     ullong *bins = (ullong *) malloc(number_of_bins * sizeof(ullong));
+     imh_compute_oph(&list, 42, number_of_bins, bins);
+     uint dense = 1;
+     for (i = 0; i < number_of_bins; i++) {
+          printf("[%u] %llu\n", i, bins[i]);
+          if (bins[i] == LARGEST_INT64)
+               dense = 0;
+     }
+     printf("All bins filled after densification: %s%s%s\n",
+            dense ? green : red, dense ? "yes" : "no", none);
+
+     // the bins of a range are the same as the ones of the whole signature
+     ullong *range = (ullong *) malloc(3 * sizeof(ullong));
+     uint equal = 1;
+     for (i = 0; i + 3 <= number_of_bins; i += 3) {
+          imh_compute_oph_range(&list, 42, number_of_bins, i, 3, range);
+          if (memcmp(range, &bins[i], 3 * sizeof(ullong)) != 0)
+               equal = 0;
+     }
+     printf("Ranges of bins computed on their own: %s%s%s\n",
+            equal ? green : red, equal ? "same as the signature" : "DIFFERENT", none);
+
+     free(range);
+     free(bins);
+     list_destroy(&list);
+}
+
+void test_rng(uint number_of_values)
+{
+     uint i, level;
+     RandomStream stream;
+     ullong *expected = (ullong *) malloc(number_of_values * sizeof(ullong));
+     ullong *values = (ullong *) malloc(number_of_values * sizeof(ullong));
+
+     printf("========== Counter-based random values ==========\n");
+     imhrng_init(&stream, 42, 7);
+     imhrng_seek(&stream, 3);
+     for (i = 0; i < number_of_values; i++)
+          expected[i] = imhrng_next(&stream);
+
+     uint equal = 1;
+     for (i = 0; i < number_of_values; i++)
+          if (expected[i] != imhrng_at(42, 7, i + 3))
+               equal = 0;
+     printf("Values computed directly from their position: %s%s%s\n",
+            equal ? green : red, equal ? "equal" : "DIFFERENT", none);
+
+     for (level = IMHKERNEL_SCALAR; level <= imhkernel_level(); level++) {
+          imhrng_init(&stream, 42, 7);
+          imhrng_seek(&stream, 2);
+          imhrng_next(&stream);
+          equal = 1;
+          for (i = 0; i < number_of_values; i += 5) {
+               uint block = min(5, number_of_values - i);
+               if (level == IMHKERNEL_AVX512)
+                    imhkernel_fill_splitmix_avx512(stream.key, stream.position, block, values + i);
+               else if (level == IMHKERNEL_AVX2)
+                    imhkernel_fill_splitmix_avx2(stream.key, stream.position, block, values + i);
+               else
+                    imhkernel_fill_splitmix_scalar(stream.key, stream.position, block, values + i);
+               imhrng_seek(&stream, stream.position + block);
+          }
+          for (i = 0; i < number_of_values; i++)
+               if (expected[i] != values[i])
+                    equal = 0;
+          printf("Values filled in blocks (%s): %s%s%s\n", imhkernel_name(level),
+                 equal ? green : red, equal ? "equal" : "DIFFERENT", none);
+     }
+
+     free(expected);
+     free(values);
+}
+
+void test_list_growth(uint number_of_items)
+{
+     uint i;
+     uint number_of_growths = 0;
+     List list;
+
+     list_init(&list);
+     for (i = 0; i < number_of_items; i++) {
+          uint capacity = list.capacity;
+          list_push(&list, list_make_item(2 * i, 1));
+          if (list.capacity != capacity)
+               number_of_growths++;
+     }
+     printf("Capacity grew %u times for %u pushes (capacity %u)\n",
+            number_of_growths, number_of_items, list.capacity);
+
+     // inserting and deleting in the middle keeps the list sorted
+     list_insert(&list, list_make_item(3, 1), 2);
+     list_delete_item(&list, list_make_item(4, 1));
+     uint sorted = list.data[1].item == 2 && list.data[2].item == 3 && list.data[3].item == 6;
+
+     // duplicated items are merged in place
+     List doubled = list_concat(&list, &list);
+     list_sort_by_item(&doubled);
+     list_unique(&doubled);
+     uint merged = doubled.size == list.size && doubled.data[0].freq == 2;
+
+     List intersection = list_intersection(&list, &doubled);
+     List union_list = list_union(&list, &doubled);
+     uint fitted = intersection.capacity == intersection.size
+          && union_list.capacity == union_list.size
+          && list_equal(&intersection, &list) && list_equal(&union_list, &doubled);
+     list_shrink_to_fit(&list);
+
+     printf("Insert/delete: %s%s%s, unique: %s%s%s, union/intersection: %s%s%s\n",
+            sorted ? green : red, sorted ? "ok" : "wrong", none,
+            merged ? green : red, merged ? "ok" : "wrong", none,
+            fitted ? green : red, fitted ? "ok" : "wrong", none);
+
+     list_destroy(&union_list);
+     list_destroy(&intersection);
+     list_destroy(&doubled);
+     list_destroy(&list);
+}
+
+void test_read_listdb(uint max_lists)
+{
+     uint i, j;
+     ListDB listdb = listdb_random(300, 20, 1000);
+
+     // lists written in the text format, with blank lines and a missing final newline
+     FILE *file = tmpfile();
+     for (i = 0; i < listdb.size; i++) {
+          fprintf(file, "%u", listdb.lists[i].size);
+          for (j = 0; j < listdb.lists[i].size; j++)
+               fprintf(file, " %u:%u", listdb.lists[i].data[j].item, listdb.lists[i].data[j].freq);
+          if (i + 1 < listdb.size)
+               fprintf(file, i % 50 ? "\n" : "\n\n");
+     }
+     rewind(file);
+
+     ListReader reader;
+     listdb_reader_open(&reader, file, "tmpfile");
+     uint equal = 1, number_of_lists = 0, number_of_batches = 0;
+     ListDB batch;
+     while ((batch = listdb_read(&reader, max_lists)).size > 0) {
+          for (i = 0; i < batch.size; i++)
+               if (!list_equal(&batch.lists[i], &listdb.lists[number_of_lists + i])
+                   || list_sum_freq(&batch.lists[i]) != list_sum_freq(&listdb.lists[number_of_lists + i]))
+                    equal = 0;
+          number_of_lists += batch.size;
+          number_of_batches++;
+          listdb_destroy(&batch);
+     }
+     listdb_destroy(&batch);
+     listdb_reader_close(&reader);
+     fclose(file);
+
+     equal = equal && number_of_lists == listdb.size;
+     printf("Read %u lists in %u batches: %s%s%s\n", number_of_lists, number_of_batches,
+            equal ? green : red, equal ? "same lists" : "DIFFERENT", none);
+     listdb_destroy(&listdb);
+}
+
+void test_load_parallel(uint number_of_threads)
+{
+     uint i;
+     char filename[] = "/tmp/test_listdbXXXXXX";
+     int fd = mkstemp(filename);
+     if (fd < 0) {
+          printf("Could not create a temporary file\n");
+          return;
+     }
+     close(fd);
+
+     // large enough to be split into several chunks
+     ListDB listdb = listdb_random(100000, 80, 1000000);
+     listdb_save_to_file(filename, &listdb);
+     ListDB loaded = listdb_load_from_file_parallel(filename, number_of_threads);
+     remove(filename);
+
+     uint equal = loaded.size == listdb.size && loaded.dim <= listdb.dim;
+     for (i = 0; equal && i < listdb.size; i++)
+          if (!list_equal(&loaded.lists[i], &listdb.lists[i]))
+               equal = 0;
+     printf("Loaded %u lists with %u threads: %s%s%s\n", loaded.size, number_of_threads,
+            equal ? green : red, equal ? "same lists" : "DIFFERENT", none);
+
+     listdb_destroy(&loaded);
+     listdb_destroy(&listdb);
+}
+
+void test_binary_listdb(void)
+{
+     uint i;
+     char filename[] = "/tmp/test_listdbXXXXXX";
+     int fd = mkstemp(filename);
+     if (fd < 0) {
+          printf("Could not create a temporary file\n");
+          return;
+     }
+     close(fd);
+
+     ListDB listdb = listdb_random(1000, 30, 5000);
+     listdb_save_to_binary_file(filename, &listdb);
+     ListDB loaded = listdb_load_from_file(filename);
+
+     uint equal = listdb_is_binary_file(filename) && loaded.mapping != NULL
+          && loaded.size == listdb.size && loaded.dim == listdb.dim;
+     for (i = 0; equal && i < listdb.size; i++)
+          if (!list_equal(&loaded.lists[i], &listdb.lists[i])
+              || list_sum_freq(&loaded.lists[i]) != list_sum_freq(&listdb.lists[i]))
+               equal = 0;
+     printf("Binary list database mapped: %s%s%s\n",
+            equal ? green : red, equal ? "same lists" : "DIFFERENT", none);
+
+     // lists of the mapped file can be modified without changing the file
+     listdb_apply_to_all(&loaded, list_sort_by_frequency);
+     listdb_push(&loaded, &loaded.lists[0]);
+     loaded.lists[0] = list_duplicate(&loaded.lists[0]);
+     list_push(&loaded.lists[0], list_make_item(1, 1));
+     listdb_destroy(&loaded);
+     loaded = listdb_load_from_binary_file(filename);
+     equal = loaded.size == listdb.size;
+     for (i = 0; equal && i < listdb.size; i++)
+          if (!list_equal(&loaded.lists[i], &listdb.lists[i]))
+               equal = 0;
+     printf("Binary list database unchanged by modifications: %s%s%s\n",
+            equal ? green : red, equal ? "yes" : "no", none);
+     remove(filename);
+
+     listdb_destroy(&loaded);
+     listdb_destroy(&listdb);
+}
+
+void test_write_listdb(void)
+{
+     uint i, j;
+     char filename[] = "/tmp/test_listdbXXXXXX";
+     int fd = mkstemp(filename);
+     if (fd < 0) {
+          printf("Could not create a temporary file\n");
+          return;
+     }
+     close(fd);
+
+     // digits of every length, including the largest value
+     uint values[] = {0, 7, 10, 99, 100, 999, 1000, 65535, 100000, 4294967295U};
+     ListDB listdb = listdb_random(500, 30, 5000);
+     for (i = 0; i < 10; i++)
+          list_push(&listdb.lists[0], list_make_item(values[i], values[9 - i]));
+     listdb_save_to_file(filename, &listdb);
+
+     FILE *file = fopen(filename, "r");
+     uint equal = file != NULL;
+     for (i = 0; equal && i < listdb.size; i++) {
+          uint size;
+          if (fscanf(file, "%u", &size) != 1 || size != listdb.lists[i].size)
+               equal = 0;
+          for (j = 0; equal && j < size; j++) {
+               uint item, freq;
+               if (fscanf(file, " %u:%u", &item, &freq) != 2
+                   || item != listdb.lists[i].data[j].item || freq != listdb.lists[i].data[j].freq)
+                    equal = 0;
+          }
+     }
+     if (file)
+          fclose(file);
+     printf("Buffered writer: %s%s%s\n", equal ? green : red, equal ? "same lists" : "DIFFERENT", none);
+
+     double **scores = (double **) malloc(listdb.size * sizeof(double *));
+     for (i = 0; i < listdb.size; i++) {
+          scores[i] = (double *) malloc((listdb.lists[i].size + 1) * sizeof(double));
+          for (j = 0; j < listdb.lists[i].size; j++)
+               scores[i][j] = (double) (i + j) / 4;
+     }
+     listdb_save_scored_to_file(filename, &listdb, scores);
+
+     file = fopen(filename, "rb");
+     char magic[8];
+     uint version;
+     equal = file != NULL && fread(magic, 1, 8, file) == 8 && fread(&version, sizeof(uint), 1, file) == 1
+          && memcmp(magic, LISTDB_RESULTS_MAGIC, 8) == 0 && version == LISTDB_RESULTS_VERSION;
+     for (i = 0; equal && i < listdb.size; i++) {
+          uint size;
+          if (fread(&size, sizeof(uint), 1, file) != 1 || size != listdb.lists[i].size)
+               equal = 0;
+          for (j = 0; equal && j < size; j++) {
+               ScoredItem record;
+               if (fread(&record, sizeof(ScoredItem), 1, file) != 1
+                   || record.item != listdb.lists[i].data[j].item
+                   || record.score != (float) scores[i][j])
+                    equal = 0;
+          }
+     }
+     if (equal && fgetc(file) != EOF)
+          equal = 0;
+     if (file)
+          fclose(file);
+     printf("Binary results: %s%s%s\n", equal ? green : red, equal ? "same neighbors and scores" : "DIFFERENT", none);
+     remove(filename);
+
+     for (i = 0; i < listdb.size; i++)
+          free(scores[i]);
+     free(scores);
+     listdb_destroy(&listdb);
+}
+
+void test_intersection_kernels(uint number_of_pairs)
+{
+     uint i, j, equal = 1;
+     uint sizes[] = {0, 1, 7, 8, 9, 16, 17, 40, 300, 2000};
+
+     for (i = 0; i < number_of_pairs; i++) {
+          uint size1 = sizes[rand() % 10], size2 = sizes[rand() % 10];
+          uint dim = 2 * (size1 > size2 ? size1 : size2) + 10;
+          List list1 = list_create(size1), list2 = list_create(size2);
+          uint *items1 = (uint *) malloc((size1 + 1) * sizeof(uint));
+          uint *items2 = (uint *) malloc((size2 + 1) * sizeof(uint));
+
+          // distinct random items in increasing order
+          uint item = 0;
+          for (j = 0; j < size1; j++, item++) {
+               item += rand() % (dim / (size1 + 1) + 1);
+               list1.data[j] = list_make_item(item, 1);
+               items1[j] = item;
+          }
+          uint max_item = size1 > 0 ? items1[size1 - 1] : 0;
+          ullong *bitmap = (ullong *) calloc(max_item / 64 + 1, sizeof(ullong));
+          for (j = 0; j < size1; j++)
+               bitmap[items1[j] >> 6] |= 1ULL << (items1[j] & 63);
+          item = 0;
+          for (j = 0; j < size2; j++, item++) {
+               item += rand() % (dim / (size2 + 1) + 1);
+               list2.data[j] = list_make_item(item, 1);
+               items2[j] = item;
+          }
+
+          // reference: one binary search per item
+          uint expected = 0;
+          for (j = 0; j < size2; j++)
+               if (list_binary_search(&list1, list2.data[j]) != NULL)
+                    expected++;
+
+          uint bitmap_size = size1 > 0 ? imhkernel_intersect_bitmap(bitmap, max_item, items2, size2) : 0;
+          if (list_intersection_size(&list1, &list2) != expected
+              || list_intersection_size_column(&list1, items2, size2) != expected
+              || imhkernel_intersect_scalar(items1, size1, items2, size2) != expected
+              || imhkernel_intersect_avx2(items1, size1, items2, size2) != expected
+              || imhkernel_intersect_gallop(items1, size1, items2, size2) != expected
+              || imhkernel_intersect_gallop(items2, size2, items1, size1) != expected
+              || imhkernel_intersection_size(items1, size1, items2, size2) != expected
+              || bitmap_size != expected)
+               equal = 0;
+
+          free(bitmap);
+          free(items1);
+          free(items2);
+          list_destroy(&list1);
+          list_destroy(&list2);
+     }
+     printf("Intersection kernels (%s): %s%s%s\n", imhkernel_name(imhkernel_level()),
+            equal ? green : red, equal ? "same sizes" : "DIFFERENT", none);
+}
+
+void test_split_list(uint sublist_size)
+{
+     uint i, j;
+     ListDB listdb = listdb_random(50, 12, 40);
+     listdb_apply_to_all(&listdb, list_sort_by_item);
+     listdb_apply_to_all(&listdb, list_unique);
+
+     Item *items = (Item *) malloc(12 * sizeof(Item));
+     List *sublists = (List *) malloc((12 / sublist_size + 1) * sizeof(List));
+     RandomStream rng;
+
+     uint partition = 1;
+     for (i = 0; i < listdb.size; i++) {
+          imhrng_init(&rng, 42, i);
+          uint number_of_sublists = imh_split_list(&listdb.lists[i], sublist_size, &rng,
+                                                   items, sublists);
+          if (number_of_sublists != listdb.lists[i].size / sublist_size)
+               partition = 0;
+
+          // the sublists together hold every item of the list exactly once
+          List joined = list_create(0);
+          for (j = 0; j < number_of_sublists; j++)
+               list_append(&joined, &sublists[j]);
+          list_sort_by_item(&joined);
+          if (number_of_sublists > 0 && !list_equal(&joined, &listdb.lists[i]))
+               partition = 0;
+          list_destroy(&joined);
+     }
+     printf("Sublists are a partition of each list: %s%s%s\n",
+            partition ? green : red, partition ? "yes" : "no", none);
+
+     free(items);
+     free(sublists);
+     listdb_destroy(&listdb);
+}
+
+void test_count_build(uint sublist_size)
+{
+     uint i, j;
+     ListDB listdb = listdb_random(200, 8, 30);
+     listdb_delete_smallest(&listdb, 3);
+     listdb_apply_to_all(&listdb, list_sort_by_item);
+     listdb_apply_to_all(&listdb, list_unique);
+
+     uint *sublist_number = (uint *) malloc(listdb.size * sizeof(uint));
+     uint sublistdb_size = imh_get_sublist_numbers(&listdb, sublist_size, sublist_number);
+     uint *sublistdb_ids = (uint *) malloc(sublistdb_size * sizeof(uint));
+     ListDB sublistdb = imh_create_sublistdb_from_listdb(&listdb, sublist_number, sublistdb_size,
+                                                         sublist_size, sublistdb_ids);
+
+     imh_init_rng(42);
+     HashTable stored = imh_create_table_hashed(512, 2, listdb.dim, sublist_size);
+     imh_store_sublistdb(&sublistdb, sublistdb_ids, &stored);
+     imh_freeze_table(&stored);
+
+     imh_init_rng(42);
+     HashTable counted = imh_create_table_hashed(512, 2, listdb.dim, sublist_size);
+     ullong minhashes[2];
+     printf("No buckets allocated before storing: %s%s%s\n",
+            counted.buckets == NULL ? green : red, counted.buckets == NULL ? "yes" : "no", none);
+     imh_start_counting(&counted);
+     for (i = 0; i < sublistdb.size; i++) {
+          imh_compute_tuple(&sublistdb.lists[i], &counted, minhashes);
+          imh_count_tuple(minhashes, &counted);
+     }
+     imh_start_filling(&counted);
+     for (i = 0; i < sublistdb.size; i++) {
+          imh_compute_tuple(&sublistdb.lists[i], &counted, minhashes);
+          imh_fill_tuple(minhashes, sublistdb_ids[i], &counted);
+     }
+     imh_finish_filling(&counted);
+
+     uint equal = 1;
+     for (i = 0; i < stored.table_size; i++)
+          if (stored.keys[i] != counted.keys[i] || stored.offsets[i + 1] != counted.offsets[i + 1])
+               equal = 0;
+     for (j = 0; equal && j < stored.offsets[stored.table_size]; j++)
+          if (stored.ids[j] != counted.ids[j])
+               equal = 0;
+     printf("Same buckets when built by counting: %s%s%s\n",
+            equal ? green : red, equal ? "yes" : "no", none);
+
+     imh_destroy_table(&stored);
+     imh_destroy_table(&counted);
+     listdb_destroy(&sublistdb);
+     listdb_destroy(&listdb);
+     free(sublist_number);
+     free(sublistdb_ids);
+}
+
 int main(int argc, char **argv)
 {
      imh_init_rng(1123123123);
      
      /* test_create_sublistdb(2); */
-     test_store_listdb(2);
+     test_store_listdb(2, IMH_SCHEME_PERMUTATIONS);
+     test_store_listdb(2, IMH_SCHEME_HASHED);
+     test_hashed_minhash();
+     test_oph(12);
+     test_rng(103);
+     test_list_growth(1000);
+     test_read_listdb(64);
+     test_load_parallel(4);
+     test_binary_listdb();
+     test_write_listdb();
+     test_intersection_kernels(2000);
+     test_split_list(3);
+     test_count_build(2);
  
      return 0;
 }